@@ -32,11 +32,17 @@
         "src/mapnik_logger.cpp",
         "src/node_mapnik.cpp",
         "src/blend.cpp",
+        "src/blend_composite.cpp",
         "src/mapnik_map.cpp",
+        "src/mapnik_map_pool.cpp",
+        "src/mapnik_thread_pool.cpp",
         "src/mapnik_color.cpp",
         "src/mapnik_geometry.cpp",
         "src/mapnik_feature.cpp",
         "src/mapnik_image.cpp",
+        "src/mapnik_image_encode.cpp",
+        "src/mapnik_encode_cache.cpp",
+        "src/mapnik_stylesheet_cache.cpp",
         "src/mapnik_image_view.cpp",
         "src/mapnik_grid.cpp",
         "src/mapnik_grid_view.cpp",
@@ -48,7 +54,9 @@
         "src/mapnik_featureset.cpp",
         "src/mapnik_expression.cpp",
         "src/mapnik_cairo_surface.cpp",
-        "src/mapnik_vector_tile.cpp"
+        "src/mapnik_vector_tile.cpp",
+        "src/mapnik_vector_tile_index.cpp",
+        "src/mapnik_vector_tile_geojson.cpp"
       ],
       "msvs_disabled_warnings": [
         4267
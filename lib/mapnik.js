@@ -3,6 +3,7 @@
 var binary = require('node-pre-gyp');
 var exists = require('fs').existsSync || require('path').existsSync;
 var path = require('path');
+var Readable = require('stream').Readable;
 var binding_path = binary.find(path.resolve(path.join(__dirname,'../package.json')));
 var settings_path = path.join(path.dirname(binding_path),'mapnik_settings.js');
 var settings = require(settings_path);
@@ -120,3 +121,15 @@ mapnik.Feature.prototype.toWKB = function() {
 mapnik.Feature.prototype.toWKT = function() {
     return this.geometry().toWKT();
 };
+
+mapnik.VectorTile.prototype.toGeoJSONStream = function(layer, options) {
+    var reader = this.toGeoJSONReader(layer === undefined ? '__all__' : layer, options || {});
+    var stream = new Readable();
+    stream._read = function() {
+        reader.read(function(err, chunk) {
+            if (err) return stream.emit('error', err);
+            stream.push(chunk);
+        });
+    };
+    return stream;
+};
@@ -0,0 +1,57 @@
+#ifndef __NODE_MAPNIK_AGG_RENDERER_VISITOR_H__
+#define __NODE_MAPNIK_AGG_RENDERER_VISITOR_H__
+
+// mapnik
+#include <mapnik/agg_renderer.hpp>      // for agg_renderer
+#include <mapnik/attribute.hpp>         // for attributes
+#include <mapnik/image.hpp>             // for image_rgba8
+#include <mapnik/map.hpp>               // for Map
+#include <mapnik/request.hpp>
+
+// stl
+#include <stdexcept>
+
+namespace node_mapnik {
+
+struct agg_renderer_visitor
+{
+    agg_renderer_visitor(mapnik::Map const& m,
+                         mapnik::request const& req,
+                         mapnik::attributes const& vars,
+                         double scale_factor,
+                         unsigned offset_x,
+                         unsigned offset_y,
+                         double scale_denominator)
+        : m_(m),
+          req_(req),
+          vars_(vars),
+          scale_factor_(scale_factor),
+          offset_x_(offset_x),
+          offset_y_(offset_y),
+          scale_denominator_(scale_denominator) {}
+
+    void operator() (mapnik::image_rgba8 & pixmap)
+    {
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(m_,req_,vars_,pixmap,scale_factor_,offset_x_,offset_y_);
+        ren.apply(scale_denominator_);
+    }
+
+    template <typename T>
+    void operator() (T &)
+    {
+        throw std::runtime_error("This image type is not currently supported for rendering.");
+    }
+
+  private:
+    mapnik::Map const& m_;
+    mapnik::request const& req_;
+    mapnik::attributes const& vars_;
+    double scale_factor_;
+    unsigned offset_x_;
+    unsigned offset_y_;
+    double scale_denominator_;
+};
+
+} // end ns
+
+#endif // __NODE_MAPNIK_AGG_RENDERER_VISITOR_H__
@@ -1,7 +1,6 @@
 #include <mapnik/image.hpp>
 #include <mapnik/version.hpp>
 #include <mapnik/image_reader.hpp>
-#include <mapnik/safe_cast.hpp>
 
 #include "zlib.h"
 
@@ -21,19 +20,26 @@
 
 #include "mapnik_palette.hpp"
 #include "blend.hpp"
+#include "blend_composite.hpp"
 #include "tint.hpp"
+#include "mapnik_thread_pool.hpp"
 #include "utils.hpp"
 
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
 #include <memory>
+#include <vector>
 
 
 
 
 namespace node_mapnik {
 
+// Outputs with fewer pixels than this are composited on one thread.
+static const int blend_band_min_pixels = 512 * 512;
+static const int blend_band_rows = 64;
+
 static bool hexToUInt32Color(char *hex, unsigned int & value) {
     if (!hex) return false;
     std::size_t len_original = strlen(hex);
@@ -144,35 +150,6 @@ static void parseTintOps(v8::Local<v8::Object> const& tint, Tinter & tinter, std
     }
 }
 
-static inline void Blend_CompositePixel(unsigned int& target, unsigned int const& source) {
-    if (source <= 0x00FFFFFF) {
-        // Top pixel is fully transparent.
-        // <do nothing>
-    } else if (source >= 0xFF000000 || target <= 0x00FFFFFF) {
-        // Top pixel is fully opaque or bottom pixel is fully transparent.
-        target = source;
-    } else {
-        // Both pixels have transparency.
-        // From http://trac.mapnik.org/browser/trunk/include/mapnik/graphics.hpp#L337
-        long a1 = (source >> 24) & 0xff;
-        long r1 = source & 0xff;
-        long g1 = (source >> 8) & 0xff;
-        long b1 = (source >> 16) & 0xff;
-
-        long a0 = (target >> 24) & 0xff;
-        long r0 = (target & 0xff) * a0;
-        long g0 = ((target >> 8) & 0xff) * a0;
-        long b0 = ((target >> 16) & 0xff) * a0;
-
-        a0 = ((a1 + a0) << 8) - a0 * a1;
-        r0 = ((((r1 << 8) - r0) * a1 + (r0 << 8)) / a0);
-        g0 = ((((g1 << 8) - g0) * a1 + (g0 << 8)) / a0);
-        b0 = ((((b1 << 8) - b0) * a1 + (b0 << 8)) / a0);
-        a0 = a0 >> 8;
-        target = (a0 << 24) | (b0 << 16) | (g0 << 8) | (r0);
-    }
-}
-
 static inline void TintPixel(unsigned & r,
                       unsigned & g,
                       unsigned & b,
@@ -194,7 +171,60 @@ static inline void TintPixel(unsigned & r,
 }
 
 
-static void Blend_Composite(unsigned int *target, BlendBaton *baton, BImage *image) {
+// The tint of a layer is the same for every pixel, so alpha is mapped through
+// a table and tinted colors are kept in a direct-mapped cache. Tinted layers
+// such as hillshades use few distinct colors, so most pixels skip the HSL
+// round trip.
+class TintTable {
+public:
+    explicit TintTable(Tinter const& tint) :
+        tint_(tint),
+        tinting_(!tint.is_identity()),
+        keys_(cache_size, 0xFFFFFFFF),
+        values_(cache_size, 0) {
+        for (unsigned a = 0; a < 256; ++a) {
+            unsigned a_new = a;
+            if (!tint.is_alpha_identity()) {
+                double a2 = tint.a0 + (a/255.0 * (tint.a1 - tint.a0));
+                if (a2 < 0) a2 = 0;
+                a_new = static_cast<unsigned>(std::floor((a2 * 255.0)+.5));
+                if (a_new > 255) a_new = 255;
+            }
+            alpha_[a] = a_new;
+        }
+    }
+
+    unsigned int apply(unsigned int source_pixel) {
+        unsigned a = alpha_[(source_pixel >> 24) & 0xff];
+        unsigned int rgb = source_pixel & 0x00FFFFFF;
+        if (a > 1 && tinting_) {
+            unsigned slot = (rgb * 2654435761u) >> (32 - cache_bits);
+            if (keys_[slot] != rgb) {
+                unsigned r = rgb & 0xff;
+                unsigned g = (rgb >> 8 ) & 0xff;
+                unsigned b = (rgb >> 16) & 0xff;
+                TintPixel(r,g,b,tint_);
+                keys_[slot] = rgb;
+                values_[slot] = (b << 16) | (g << 8) | (r);
+            }
+            rgb = values_[slot];
+        }
+        return (a << 24) | rgb;
+    }
+
+private:
+    static const unsigned cache_bits = 12;
+    static const unsigned cache_size = 1u << cache_bits;
+    Tinter const& tint_;
+    bool tinting_;
+    unsigned alpha_[256];
+    std::vector<unsigned int> keys_;
+    std::vector<unsigned int> values_;
+};
+
+// Composites the rows of `image` that fall within rows [band_start, band_end)
+// of the target.
+static void Blend_Composite(unsigned int *target, BlendBaton *baton, BImage *image, int band_start, int band_end) {
     const unsigned int *source = image->im_ptr->data();
 
     int sourceX = std::max(0, -image->x);
@@ -207,36 +237,28 @@ static void Blend_Composite(unsigned int *target, BlendBaton *baton, BImage *ima
     int targetX = std::max(0, image->x);
     int targetY = std::max(0, image->y);
     int targetPos = targetY * baton->width + targetX;
+
+    int first = std::max(0, band_start - targetY);
+    int last = std::min(height, band_end - targetY);
+    if (width <= 0 || first >= last) return;
+    sourcePos += first * image->width;
+    targetPos += first * baton->width;
     bool tinting = !image->tint.is_identity();
     bool set_alpha = !image->tint.is_alpha_identity();
     if (tinting || set_alpha) {
-        for (int y = 0; y < height; ++y) {
+        TintTable table(image->tint);
+        std::vector<unsigned int> row(width);
+        for (int y = first; y < last; ++y) {
             for (int x = 0; x < width; ++x) {
-                unsigned int const& source_pixel = source[sourcePos + x];
-                unsigned a = (source_pixel >> 24) & 0xff;
-                if (set_alpha) {
-                    double a2 = image->tint.a0 + (a/255.0 * (image->tint.a1 - image->tint.a0));
-                    if (a2 < 0) a2 = 0;
-                    a = static_cast<unsigned>(std::floor((a2 * 255.0)+.5));
-                    if (a > 255) a = 255;
-                }
-                unsigned r = source_pixel & 0xff;
-                unsigned g = (source_pixel >> 8 ) & 0xff;
-                unsigned b = (source_pixel >> 16) & 0xff;
-                if (a > 1 && tinting) {
-                    TintPixel(r,g,b,image->tint);
-                }
-                unsigned int new_pixel = (a << 24) | (b << 16) | (g << 8) | (r);
-                Blend_CompositePixel(target[targetPos + x], new_pixel);
+                row[x] = table.apply(source[sourcePos + x]);
             }
+            composite_row(target + targetPos, row.data(), width);
             sourcePos += image->width;
             targetPos += baton->width;
         }
     } else {
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                Blend_CompositePixel(target[targetPos + x], source[sourcePos + x]);
-            }
+        for (int y = first; y < last; ++y) {
+            composite_row(target + targetPos, source + sourcePos, width);
             sourcePos += image->width;
             targetPos += baton->width;
         }
@@ -299,14 +321,30 @@ static void Blend_Encode(mapnik::image_rgba8 const& image, BlendBaton* baton, bo
     }
 }
 
+// A layer to decode: `x` and `y` are the offset of the visible window
+// within the encoded image.
+struct BlendLayer {
+    BlendLayer() :
+        image(nullptr),
+        reader(),
+        x(0),
+        y(0) {}
+    BImage * image;
+    std::unique_ptr<mapnik::image_reader> reader;
+    unsigned x;
+    unsigned y;
+};
+
 void Work_Blend(uv_work_t* req)
 {
     BlendBaton* baton = static_cast<BlendBaton*>(req->data);
     bool alpha = true;
     int size = 0;
+    std::vector<BlendLayer> layers;
 
     // Iterate from the last to first image because we potentially don't have
-    // to decode all images if there's an opaque one.
+    // to decode all images if there's an opaque one. Only the headers are
+    // read here, the pixels are decoded below.
     Images::reverse_iterator rit = baton->images.rbegin();
     Images::reverse_iterator rend = baton->images.rend();
     for (; rit != rend; ++rit)
@@ -365,17 +403,7 @@ void Work_Blend(uv_work_t* req)
             image->x == 0 && image->y == 0 &&
             (int)layer_width == baton->width && (int)layer_height == baton->height)
         {
-            baton->stream.write((char *)image->data, image->dataLength);
-            return;
-        }
-
-        // allocate image for decoded pixels
-        std::unique_ptr<mapnik::image_rgba8> im_ptr(new mapnik::image_rgba8(layer_width,layer_height));
-        // actually decode pixels now
-        try {
-            image_reader->read(0,0,*im_ptr);
-        } catch (std::exception const&) {
-            baton->message = "Could not decode image";
+            baton->passthrough = image;
             return;
         }
 
@@ -386,12 +414,35 @@ void Work_Blend(uv_work_t* req)
             alpha = false;
         }
 
-        // Convenience aliases.
-        image->width = layer_width;
-        image->height = layer_height;
-        image->im_ptr = std::move(im_ptr);
+        // Only the part of the layer inside the viewport is decoded. From
+        // here on the image stands for that window.
+        int sourceX = std::max(0, -image->x);
+        int sourceY = std::max(0, -image->y);
+        BlendLayer layer;
+        layer.image = &*image;
+        layer.reader = std::move(image_reader);
+        layer.x = sourceX;
+        layer.y = sourceY;
+        image->width = (int)layer_width - sourceX - std::max(0, visibleWidth - baton->width);
+        image->height = (int)layer_height - sourceY - std::max(0, visibleHeight - baton->height);
+        image->x = std::max(0, image->x);
+        image->y = std::max(0, image->y);
+        layers.push_back(std::move(layer));
         ++size;
+    }
 
+    // Decode the pixels of the layers that are visible, in parallel when
+    // asked to.
+    try {
+        parallel_for(layers.size(), baton->threads, [&](std::size_t i) {
+            BImage * image = layers[i].image;
+            std::unique_ptr<mapnik::image_rgba8> im_ptr(new mapnik::image_rgba8(image->width, image->height));
+            layers[i].reader->read(layers[i].x, layers[i].y, *im_ptr);
+            image->im_ptr = std::move(im_ptr);
+        });
+    } catch (std::exception const&) {
+        baton->message = "Could not decode image";
+        return;
     }
 
     // Now blend images.
@@ -408,13 +459,24 @@ void Work_Blend(uv_work_t* req)
     if (alpha) {
         target.set(baton->matte);
     }
-    for (auto image_ptr : baton->images)
-    {
-        if (image_ptr && image_ptr->im_ptr.get())
+    // Large outputs are composited in bands of rows, each band going
+    // through every layer in order.
+    int band_height = baton->height;
+    if (baton->threads > 1 && pixels >= blend_band_min_pixels) {
+        band_height = blend_band_rows;
+    }
+    std::size_t bands = (baton->height + band_height - 1) / band_height;
+    parallel_for(bands, baton->threads, [&](std::size_t band) {
+        int band_start = static_cast<int>(band) * band_height;
+        int band_end = std::min(baton->height, band_start + band_height);
+        for (auto const& image_ptr : baton->images)
         {
-            Blend_Composite(target.data(), baton, &*image_ptr);
+            if (image_ptr && image_ptr->im_ptr.get())
+            {
+                Blend_Composite(target.data(), baton, &*image_ptr, band_start, band_end);
+            }
         }
-    }
+    });
     Blend_Encode(target, baton, alpha);
 }
 
@@ -423,10 +485,19 @@ void Work_AfterBlend(uv_work_t* req) {
     BlendBaton* baton = static_cast<BlendBaton*>(req->data);
 
     if (!baton->message.length()) {
-        std::string result = baton->stream.str();
+        v8::Local<v8::Object> result;
+        if (baton->passthrough) {
+            result = Nan::New(baton->passthrough->buffer);
+        } else {
+            std::string * data = baton->output.release();
+            result = Nan::NewBuffer(&(*data)[0],
+                                    data->size(),
+                                    node_mapnik::delete_buffer_owner<std::string>,
+                                    data).ToLocalChecked();
+        }
         v8::Local<v8::Value> argv[] = {
             Nan::Null(),
-            Nan::CopyBuffer((char *)result.data(), mapnik::safe_cast<std::uint32_t>(result.length())).ToLocalChecked(),
+            result
         };
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(baton->callback), 2, argv);
     } else {
@@ -449,7 +520,9 @@ void Work_AfterBlend(uv_work_t* req) {
  * @param {Object} options can include width, height, `compression`,
  * `reencode`, palette, mode can be either `hextree` or `octree`, quality. JPEG & WebP quality
  * quality ranges from 0-100, PNG quality from 2-256. Compression varies by platform -
- * it references the internal zlib compression algorithm.
+ * it references the internal zlib compression algorithm. `threads` (default 1) is the
+ * number of threads used to decode the layers and to composite large images, taken
+ * from a pool shared by all blends.
  * @param {Function} callback called with (err, res), where a successful
  * result is a processed image as a Buffer
  * @example
@@ -570,6 +643,15 @@ NAN_METHOD(Blend) {
             }
         }
 
+        if (options->Has(Nan::New("threads").ToLocalChecked())) {
+            v8::Local<v8::Value> threads_val = options->Get(Nan::New("threads").ToLocalChecked());
+            if (!threads_val->IsNumber() || threads_val->IntegerValue() < 0) {
+                Nan::ThrowTypeError("Threads option must be a non-negative integer");
+                return;
+            }
+            baton->threads = threads_val->IntegerValue();
+        }
+
         int min_compression = Z_NO_COMPRESSION;
         int max_compression = Z_BEST_COMPRESSION;
         if (baton->format == BLEND_FORMAT_PNG) {
@@ -671,7 +753,7 @@ NAN_METHOD(Blend) {
         baton->images.push_back(image);
     }
 
-    uv_queue_work(uv_default_loop(), &(baton.release())->request, Work_Blend, (uv_after_work_cb)Work_AfterBlend);
+    node_mapnik::queue_work(&(baton.release())->request, Work_Blend, (uv_after_work_cb)Work_AfterBlend, node_mapnik::WORK_CLASS_ENCODE);
 
     return;
 }
@@ -8,12 +8,13 @@
 #pragma GCC diagnostic pop
 
 // stl
-#include <sstream>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <memory>
 #include "mapnik_palette.hpp"
 #include "tint.hpp"
+#include "utils.hpp"
 
 namespace node_mapnik {
 
@@ -71,7 +72,15 @@ struct BlendBaton {
     unsigned int matte;
     int compression;
     AlphaMode mode;
-    std::ostringstream stream;
+    unsigned threads;
+    // Set when the result is one of the input images as is; its Buffer is
+    // then returned instead of a copy.
+    ImagePtr passthrough;
+    // The encoders write through `stream` into `output`, which is handed
+    // over to the result Buffer.
+    std::unique_ptr<std::string> output;
+    string_streambuf output_buffer;
+    std::ostream stream;
 
     BlendBaton() :
         quality(0),
@@ -82,7 +91,11 @@ struct BlendBaton {
         matte(0),
         compression(-1),
         mode(BLEND_MODE_HEXTREE),
-        stream(std::ios::out | std::ios::binary)
+        threads(1),
+        passthrough(),
+        output(new std::string()),
+        output_buffer(*output),
+        stream(&output_buffer)
     {
         this->request.data = this;
     }
@@ -0,0 +1,186 @@
+#include "blend_composite.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NODE_MAPNIK_BLEND_SIMD
+#include <immintrin.h>
+#endif
+
+namespace node_mapnik {
+
+namespace {
+
+inline void composite_pixel(unsigned int& target, unsigned int const& source) {
+    if (source <= 0x00FFFFFF) {
+        // Top pixel is fully transparent.
+        // <do nothing>
+    } else if (source >= 0xFF000000 || target <= 0x00FFFFFF) {
+        // Top pixel is fully opaque or bottom pixel is fully transparent.
+        target = source;
+    } else {
+        // Both pixels have transparency.
+        // From http://trac.mapnik.org/browser/trunk/include/mapnik/graphics.hpp#L337
+        long a1 = (source >> 24) & 0xff;
+        long r1 = source & 0xff;
+        long g1 = (source >> 8) & 0xff;
+        long b1 = (source >> 16) & 0xff;
+
+        long a0 = (target >> 24) & 0xff;
+        long r0 = (target & 0xff) * a0;
+        long g0 = ((target >> 8) & 0xff) * a0;
+        long b0 = ((target >> 16) & 0xff) * a0;
+
+        a0 = ((a1 + a0) << 8) - a0 * a1;
+        r0 = ((((r1 << 8) - r0) * a1 + (r0 << 8)) / a0);
+        g0 = ((((g1 << 8) - g0) * a1 + (g0 << 8)) / a0);
+        b0 = ((((b1 << 8) - b0) * a1 + (b0 << 8)) / a0);
+        a0 = a0 >> 8;
+        target = (a0 << 24) | (b0 << 16) | (g0 << 8) | (r0);
+    }
+}
+
+void composite_row_scalar(unsigned int * target, unsigned int const* source, int width) {
+    for (int x = 0; x < width; ++x) {
+        composite_pixel(target[x], source[x]);
+    }
+}
+
+#if defined(NODE_MAPNIK_BLEND_SIMD)
+
+// The vector kernels compute the same integer expressions as
+// composite_pixel. The numerators are non-negative and below 2^25 and the
+// denominator below 2^16, so truncating the correctly rounded double
+// quotient gives exactly the integer quotient.
+
+__attribute__((target("sse4.1")))
+inline __m128i divide_sse41(__m128i num, __m128d den_lo, __m128d den_hi) {
+    __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(num), den_lo);
+    __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(num, num)), den_hi);
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+__attribute__((target("sse4.1")))
+void composite_row_sse41(unsigned int * target, unsigned int const* source, int width) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const opaque = _mm_set1_epi32(0xff);
+    __m128i const one = _mm_set1_epi32(1);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x));
+        __m128i a1 = _mm_srli_epi32(s, 24);
+        __m128i skip = _mm_cmpeq_epi32(a1, zero);
+        int skip_mask = _mm_movemask_epi8(skip);
+        if (skip_mask == 0xffff) {
+            continue;
+        }
+        __m128i t = _mm_loadu_si128(reinterpret_cast<__m128i const*>(target + x));
+        __m128i a0 = _mm_srli_epi32(t, 24);
+        __m128i replace = _mm_andnot_si128(skip, _mm_or_si128(_mm_cmpeq_epi32(a1, opaque),
+                                                               _mm_cmpeq_epi32(a0, zero)));
+        __m128i result = t;
+        if ((skip_mask | _mm_movemask_epi8(replace)) != 0xffff) {
+            __m128i r1 = _mm_and_si128(s, opaque);
+            __m128i g1 = _mm_and_si128(_mm_srli_epi32(s, 8), opaque);
+            __m128i b1 = _mm_and_si128(_mm_srli_epi32(s, 16), opaque);
+            __m128i r0 = _mm_mullo_epi32(_mm_and_si128(t, opaque), a0);
+            __m128i g0 = _mm_mullo_epi32(_mm_and_si128(_mm_srli_epi32(t, 8), opaque), a0);
+            __m128i b0 = _mm_mullo_epi32(_mm_and_si128(_mm_srli_epi32(t, 16), opaque), a0);
+            __m128i a = _mm_sub_epi32(_mm_slli_epi32(_mm_add_epi32(a1, a0), 8), _mm_mullo_epi32(a0, a1));
+            // lanes that are not blended may have a zero denominator
+            __m128i den = _mm_max_epi32(a, one);
+            __m128d den_lo = _mm_cvtepi32_pd(den);
+            __m128d den_hi = _mm_cvtepi32_pd(_mm_unpackhi_epi64(den, den));
+            __m128i r = divide_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(r1, 8), r0), a1),
+                                                   _mm_slli_epi32(r0, 8)), den_lo, den_hi);
+            __m128i g = divide_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(g1, 8), g0), a1),
+                                                   _mm_slli_epi32(g0, 8)), den_lo, den_hi);
+            __m128i b = divide_sse41(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_slli_epi32(b1, 8), b0), a1),
+                                                   _mm_slli_epi32(b0, 8)), den_lo, den_hi);
+            result = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(a, 8), 24), _mm_slli_epi32(b, 16)),
+                                  _mm_or_si128(_mm_slli_epi32(g, 8), r));
+            result = _mm_blendv_epi8(result, t, skip);
+        }
+        result = _mm_blendv_epi8(result, s, replace);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target + x), result);
+    }
+    composite_row_scalar(target + x, source + x, width - x);
+}
+
+__attribute__((target("avx2")))
+inline __m256i divide_avx2(__m256i num, __m256d den_lo, __m256d den_hi) {
+    __m256d lo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(num)), den_lo);
+    __m256d hi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(num, 1)), den_hi);
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)), _mm256_cvttpd_epi32(hi), 1);
+}
+
+__attribute__((target("avx2")))
+void composite_row_avx2(unsigned int * target, unsigned int const* source, int width) {
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const opaque = _mm256_set1_epi32(0xff);
+    __m256i const one = _mm256_set1_epi32(1);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(source + x));
+        __m256i a1 = _mm256_srli_epi32(s, 24);
+        __m256i skip = _mm256_cmpeq_epi32(a1, zero);
+        unsigned skip_mask = static_cast<unsigned>(_mm256_movemask_epi8(skip));
+        if (skip_mask == 0xffffffffu) {
+            continue;
+        }
+        __m256i t = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(target + x));
+        __m256i a0 = _mm256_srli_epi32(t, 24);
+        __m256i replace = _mm256_andnot_si256(skip, _mm256_or_si256(_mm256_cmpeq_epi32(a1, opaque),
+                                                                    _mm256_cmpeq_epi32(a0, zero)));
+        __m256i result = t;
+        if ((skip_mask | static_cast<unsigned>(_mm256_movemask_epi8(replace))) != 0xffffffffu) {
+            __m256i r1 = _mm256_and_si256(s, opaque);
+            __m256i g1 = _mm256_and_si256(_mm256_srli_epi32(s, 8), opaque);
+            __m256i b1 = _mm256_and_si256(_mm256_srli_epi32(s, 16), opaque);
+            __m256i r0 = _mm256_mullo_epi32(_mm256_and_si256(t, opaque), a0);
+            __m256i g0 = _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(t, 8), opaque), a0);
+            __m256i b0 = _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(t, 16), opaque), a0);
+            __m256i a = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_add_epi32(a1, a0), 8), _mm256_mullo_epi32(a0, a1));
+            // lanes that are not blended may have a zero denominator
+            __m256i den = _mm256_max_epi32(a, one);
+            __m256d den_lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(den));
+            __m256d den_hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(den, 1));
+            __m256i r = divide_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(r1, 8), r0), a1),
+                                                     _mm256_slli_epi32(r0, 8)), den_lo, den_hi);
+            __m256i g = divide_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(g1, 8), g0), a1),
+                                                     _mm256_slli_epi32(g0, 8)), den_lo, den_hi);
+            __m256i b = divide_avx2(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_slli_epi32(b1, 8), b0), a1),
+                                                     _mm256_slli_epi32(b0, 8)), den_lo, den_hi);
+            result = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(a, 8), 24), _mm256_slli_epi32(b, 16)),
+                                     _mm256_or_si256(_mm256_slli_epi32(g, 8), r));
+            result = _mm256_blendv_epi8(result, t, skip);
+        }
+        result = _mm256_blendv_epi8(result, s, replace);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + x), result);
+    }
+    composite_row_scalar(target + x, source + x, width - x);
+}
+
+#endif // NODE_MAPNIK_BLEND_SIMD
+
+typedef void (*composite_row_fn)(unsigned int *, unsigned int const*, int);
+
+composite_row_fn select_composite_row() {
+#if defined(NODE_MAPNIK_BLEND_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return composite_row_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return composite_row_sse41;
+    }
+#endif
+    return composite_row_scalar;
+}
+
+} // end anonymous ns
+
+void composite_row(unsigned int * target, unsigned int const* source, int width) {
+    static composite_row_fn const fn = select_composite_row();
+    fn(target, source, width);
+}
+
+}
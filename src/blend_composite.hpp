@@ -0,0 +1,13 @@
+#ifndef NODE_MAPNIK_BLEND_COMPOSITE_HPP
+#define NODE_MAPNIK_BLEND_COMPOSITE_HPP
+
+namespace node_mapnik {
+
+// Composites `width` non-premultiplied RGBA pixels of `source` over
+// `target` (source-over), in place. Uses SSE4.1 or AVX2 when the CPU
+// supports it; the result is the same bit for bit on every path.
+void composite_row(unsigned int * target, unsigned int const* source, int width);
+
+}
+
+#endif // NODE_MAPNIK_BLEND_COMPOSITE_HPP
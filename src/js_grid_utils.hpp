@@ -9,10 +9,18 @@
 #include "utils.hpp"
 
 // stl
+#include <algorithm>
 #include <cmath> // ceil
+#include <cstdint>
+#include <cstdio>
 #include <stdint.h>  // for uint16_t
 
 #include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 
 
@@ -21,80 +29,201 @@ namespace node_mapnik {
 
 typedef std::unique_ptr<uint16_t[]> grid_line_type;
 
+// Maps the feature ids of a grid to the keys they were rendered with and
+// to the codepoints handed out for them. Ids are looked up in a flat array
+// when they are close enough together, which is the usual case, and in a
+// hash table otherwise.
+template <typename T>
+class grid_key_table
+{
+public:
+    typedef typename T::value_type value_type;
+    typedef typename T::lookup_type lookup_type;
+
+    struct entry
+    {
+        entry()
+            : key(nullptr),
+              codepoint(0) {}
+        lookup_type const* key;
+        uint16_t codepoint;
+    };
+
+    explicit grid_key_table(typename T::feature_key_type const& feature_keys)
+        : min_id_(0),
+          base_(),
+          dense_()
+    {
+        // Every grid has a key for the background, `base_mask`, which is the
+        // smallest id there is. It is kept apart so that the range of the
+        // feature ids decides between the flat table and the hash map.
+        bool first = true;
+        value_type max_id = 0;
+        std::size_t count = 0;
+        for (auto const& item : feature_keys)
+        {
+            if (item.first == mapnik::grid::base_mask)
+            {
+                base_.key = &item.second;
+                continue;
+            }
+            if (first || item.first < min_id_) min_id_ = item.first;
+            if (first || item.first > max_id) max_id = item.first;
+            first = false;
+            ++count;
+        }
+        if (count == 0)
+        {
+            return;
+        }
+        std::uint64_t range = static_cast<std::uint64_t>(max_id) -
+                              static_cast<std::uint64_t>(min_id_);
+        if (range < std::max<std::uint64_t>(65536, 4 * count))
+        {
+            dense_.resize(static_cast<std::size_t>(range) + 1);
+            for (auto const& item : feature_keys)
+            {
+                if (item.first != mapnik::grid::base_mask)
+                {
+                    dense_[index(item.first)].key = &item.second;
+                }
+            }
+        }
+        else
+        {
+            sparse_.reserve(count);
+            for (auto const& item : feature_keys)
+            {
+                if (item.first != mapnik::grid::base_mask)
+                {
+                    sparse_[item.first].key = &item.second;
+                }
+            }
+        }
+    }
+
+    // Returns null for ids the grid has no key for.
+    entry * find(value_type id)
+    {
+        if (id == mapnik::grid::base_mask)
+        {
+            return base_.key ? &base_ : nullptr;
+        }
+        if (!dense_.empty())
+        {
+            if (id < min_id_) return nullptr;
+            std::uint64_t i = index(id);
+            if (i >= dense_.size() || !dense_[i].key) return nullptr;
+            return &dense_[i];
+        }
+        auto itr = sparse_.find(id);
+        if (itr == sparse_.end()) return nullptr;
+        return &itr->second;
+    }
+
+private:
+    std::size_t index(value_type id) const
+    {
+        return static_cast<std::size_t>(static_cast<std::uint64_t>(id) - static_cast<std::uint64_t>(min_id_));
+    }
+
+    value_type min_id_;
+    entry base_;
+    std::vector<entry> dense_;
+    std::unordered_map<value_type, entry> sparse_;
+};
+
 template <typename T>
 static void grid2utf(T const& grid_type,
                      std::vector<grid_line_type> & lines,
                      std::vector<typename T::lookup_type>& key_order,
                      unsigned int resolution)
 {
-    typedef std::map< typename T::lookup_type, typename T::value_type> keys_type;
-    typedef typename keys_type::const_iterator keys_iterator;
-
-    typename T::feature_key_type const& feature_keys = grid_type.get_feature_keys();
-    typename T::feature_key_type::const_iterator feature_pos;
+    typedef grid_key_table<T> table_type;
+    typedef std::unordered_map<typename T::lookup_type, uint16_t> keys_type;
 
+    table_type table(grid_type.get_feature_keys());
     keys_type keys;
     // start counting at utf8 codepoint 32, aka space character
     uint16_t codepoint = 32;
 
     unsigned array_size = std::ceil(grid_type.width()/static_cast<float>(resolution));
+    lines.reserve(lines.size() + (grid_type.height() + resolution - 1) / resolution);
     for (unsigned y = 0; y < grid_type.height(); y=y+resolution)
     {
         uint16_t idx = 0;
         grid_line_type line(new uint16_t[array_size]);
         typename T::value_type const* row = grid_type.get_row(y);
+        // Neighbouring pixels mostly belong to the same feature, so the last
+        // lookup is reused for runs of the same id.
+        typename T::value_type last_id = 0;
+        typename table_type::entry * last = nullptr;
         for (unsigned x = 0; x < grid_type.width(); x=x+resolution)
         {
-            // todo - this lookup is expensive
             typename T::value_type feature_id = row[x];
-            feature_pos = feature_keys.find(feature_id);
-            if (feature_pos != feature_keys.end())
+            typename table_type::entry * item = (last && feature_id == last_id) ? last : table.find(feature_id);
+            if (!item)
             {
-                typename T::lookup_type const& val = feature_pos->second;
-                keys_iterator key_pos = keys.find(val);
+                // shouldn't get here...
+                continue;
+            }
+            if (item->codepoint == 0)
+            {
+                // First time this id is seen. Ids rendered with the same key
+                // share its codepoint.
+                std::string const& val = (feature_id == mapnik::grid::base_mask) ? std::string() : *item->key;
+                auto key_pos = keys.find(val);
                 if (key_pos == keys.end())
                 {
                     // Create a new entry for this key. Skip the codepoints that
                     // can't be encoded directly in JSON.
                     if (codepoint == 34) ++codepoint;      // Skip "
                     else if (codepoint == 92) ++codepoint; // Skip backslash
-                    if (feature_id == mapnik::grid::base_mask)
-                    {
-                        keys[""] = codepoint;
-                        key_order.emplace_back("");
-                    }
-                    else
-                    {
-                        keys[val] = codepoint;
-                        key_order.push_back(val);
-                    }
-                    line[idx++] = static_cast<uint16_t>(codepoint);
-                    ++codepoint;
+                    keys.emplace(val, codepoint);
+                    key_order.push_back(val);
+                    item->codepoint = codepoint++;
                 }
                 else
                 {
-                    line[idx++] = static_cast<uint16_t>(key_pos->second);
+                    item->codepoint = key_pos->second;
                 }
             }
-            // else, shouldn't get here...
+            line[idx++] = item->codepoint;
+            last_id = feature_id;
+            last = item;
         }
         lines.push_back(std::move(line));
     }
 }
 
 
+// Attributes of the features an encoded grid refers to, in key order.
+// They are gathered in the worker so the main thread only has to turn them
+// into JavaScript objects.
+struct grid_features
+{
+    struct feature
+    {
+        std::string key;
+        // index into `fields` and value
+        std::vector<std::pair<std::size_t, mapnik::value> > attributes;
+    };
+    std::vector<std::string> fields;
+    std::vector<feature> features;
+};
+
 template <typename T>
-static void write_features(T const& grid_type,
-                           v8::Local<v8::Object>& feature_data,
-                           std::vector<typename T::lookup_type> const& key_order)
+static void gather_features(T const& grid_type,
+                            std::vector<typename T::lookup_type> const& key_order,
+                            grid_features & data)
 {
-    Nan::HandleScope scope;
     typename T::feature_type const& g_features = grid_type.get_grid_features();
     if (g_features.size() <= 0)
     {
         return;
     }
     std::set<std::string> const& attributes = grid_type.get_fields();
+    data.fields.assign(attributes.begin(), attributes.end());
     typename T::feature_type::const_iterator feat_end = g_features.end();
     for (std::string const& key_item : key_order)
     {
@@ -110,29 +239,182 @@ static void write_features(T const& grid_type,
         }
 
         bool found = false;
-        v8::Local<v8::Object> feat = Nan::New<v8::Object>();
+        grid_features::feature feat;
         mapnik::feature_ptr feature = feat_itr->second;
-        for (std::string const& attr : attributes)
+        for (std::size_t i = 0; i < data.fields.size(); ++i)
         {
+            std::string const& attr = data.fields[i];
             if (attr == "__id__")
             {
-                feat->Set(Nan::New<v8::String>(attr).ToLocalChecked(), Nan::New<v8::Number>(feature->id()));
+                feat.attributes.emplace_back(i, mapnik::value(feature->id()));
             }
             else if (feature->has_key(attr))
             {
                 found = true;
-                mapnik::feature_impl::value_type const& attr_val = feature->get(attr);
-                feat->Set(Nan::New<v8::String>(attr).ToLocalChecked(),
-                    mapnik::util::apply_visitor(node_mapnik::value_converter(),
-                    attr_val));
+                feat.attributes.emplace_back(i, feature->get(attr));
             }
         }
 
         if (found)
         {
-            feature_data->Set(Nan::New<v8::String>(feat_itr->first).ToLocalChecked(), feat);
+            feat.key = feat_itr->first;
+            data.features.push_back(std::move(feat));
+        }
+    }
+}
+
+static inline void write_features(grid_features const& data,
+                                  v8::Local<v8::Object>& feature_data)
+{
+    Nan::HandleScope scope;
+    std::vector<v8::Local<v8::String> > names;
+    names.reserve(data.fields.size());
+    for (std::string const& field : data.fields)
+    {
+        names.push_back(Nan::New<v8::String>(field).ToLocalChecked());
+    }
+    for (grid_features::feature const& feature : data.features)
+    {
+        v8::Local<v8::Object> feat = Nan::New<v8::Object>();
+        for (auto const& attr : feature.attributes)
+        {
+            feat->Set(names[attr.first],
+                mapnik::util::apply_visitor(node_mapnik::value_converter(),
+                attr.second));
+        }
+        feature_data->Set(Nan::New<v8::String>(feature.key).ToLocalChecked(), feat);
+    }
+}
+
+template <typename T>
+static void write_features(T const& grid_type,
+                           v8::Local<v8::Object>& feature_data,
+                           std::vector<typename T::lookup_type> const& key_order)
+{
+    grid_features data;
+    gather_features(grid_type, key_order, data);
+    write_features(data, feature_data);
+}
+
+// Appends a line of UTF-16 code units as a JSON string in UTF-8. Control
+// characters and lone surrogates are escaped.
+inline void write_json_grid_line(std::string & out, uint16_t const* units, std::size_t size)
+{
+    out += '"';
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        unsigned c = units[i];
+        if (c >= 0xd800 && c <= 0xdbff && i + 1 < size &&
+            units[i + 1] >= 0xdc00 && units[i + 1] <= 0xdfff)
+        {
+            unsigned cp = 0x10000 + ((c - 0xd800) << 10) + (units[++i] - 0xdc00);
+            out += static_cast<char>(0xf0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        else if (c < 0x20 || c == '"' || c == '\\' || (c >= 0xd800 && c <= 0xdfff))
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else if (c < 0x80)
+        {
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            out += static_cast<char>(0xc0 | (c >> 6));
+            out += static_cast<char>(0x80 | (c & 0x3f));
+        }
+        else
+        {
+            out += static_cast<char>(0xe0 | (c >> 12));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (c & 0x3f));
+        }
+    }
+    out += '"';
+}
+
+struct json_value_writer
+{
+    explicit json_value_writer(std::string & out)
+        : out_(out) {}
+
+    void operator() (mapnik::value_null const&) const
+    {
+        out_ += "null";
+    }
+
+    void operator() (mapnik::value_bool val) const
+    {
+        out_ += val ? "true" : "false";
+    }
+
+    void operator() (mapnik::value_integer val) const
+    {
+        out_ += std::to_string(val);
+    }
+
+    void operator() (mapnik::value_double val) const
+    {
+        // matches the values `encode` returns as numbers
+        write_json_number(out_, val);
+    }
+
+    void operator() (mapnik::value_unicode_string const& val) const
+    {
+        std::string buffer;
+        mapnik::to_utf8(val, buffer);
+        write_json_string(out_, buffer);
+    }
+
+    std::string & out_;
+};
+
+// Serializes the encoded grid as the UTFGrid JSON document, with the same
+// `grid`, `keys` and `data` members as the object `encode` returns.
+template <typename T>
+static void grid2json(T const& grid_type,
+                      std::vector<grid_line_type> const& lines,
+                      std::vector<typename T::lookup_type> const& key_order,
+                      unsigned int resolution,
+                      grid_features const& data,
+                      std::string & out)
+{
+    unsigned array_size = std::ceil(grid_type.width()/static_cast<float>(resolution));
+    out.reserve(out.size() + lines.size() * (array_size + 3) + 32);
+    out += "{\"grid\":[";
+    for (std::size_t j = 0; j < lines.size(); ++j)
+    {
+        if (j > 0) out += ',';
+        write_json_grid_line(out, lines[j].get(), array_size);
+    }
+    out += "],\"keys\":[";
+    for (std::size_t j = 0; j < key_order.size(); ++j)
+    {
+        if (j > 0) out += ',';
+        write_json_string(out, key_order[j]);
+    }
+    out += "],\"data\":{";
+    for (std::size_t j = 0; j < data.features.size(); ++j)
+    {
+        grid_features::feature const& feature = data.features[j];
+        if (j > 0) out += ',';
+        write_json_string(out, feature.key);
+        out += ":{";
+        for (std::size_t k = 0; k < feature.attributes.size(); ++k)
+        {
+            if (k > 0) out += ',';
+            write_json_string(out, data.fields[feature.attributes[k].first]);
+            out += ':';
+            mapnik::util::apply_visitor(json_value_writer(out), feature.attributes[k].second);
         }
+        out += '}';
     }
+    out += "}}";
 }
 
 }
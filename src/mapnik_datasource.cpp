@@ -14,10 +14,61 @@
 
 // stl
 #include <exception>
+#include <string>
 #include <vector>
 
 Nan::Persistent<v8::FunctionTemplate> Datasource::constructor;
 
+namespace {
+
+void options_to_params(v8::Local<v8::Object> const& options, mapnik::parameters & params)
+{
+    v8::Local<v8::Array> names = options->GetPropertyNames();
+    unsigned int i = 0;
+    unsigned int a_length = names->Length();
+    while (i < a_length) {
+        v8::Local<v8::Value> name = names->Get(i)->ToString();
+        v8::Local<v8::Value> value = options->Get(name);
+        // TODO - don't treat everything as strings
+        params[TOSTR(name)] = const_cast<char const*>(TOSTR(value));
+        i++;
+    }
+}
+
+mapnik::featureset_ptr query_features(datasource_ptr const& ds, mapnik::box2d<double> const& extent)
+{
+    mapnik::query q(extent);
+    mapnik::layer_descriptor ld = ds->get_descriptor();
+    auto const& desc = ld.get_descriptors();
+    for (auto const& attr_info : desc)
+    {
+        q.add_property_name(attr_info.get_name());
+    }
+    return ds->features(q);
+}
+
+typedef struct {
+    uv_work_t request;
+    mapnik::parameters params;
+    datasource_ptr ds;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+} datasource_create_baton_t;
+
+typedef struct {
+    uv_work_t request;
+    Datasource* d;
+    bool has_extent;
+    mapnik::box2d<double> extent;
+    mapnik::featureset_ptr fs;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+} datasource_featureset_baton_t;
+
+} // end anonymous ns
+
 /**
  * **`mapnik.Datasource`**
  *
@@ -41,6 +92,10 @@ void Datasource::Initialize(v8::Local<v8::Object> target) {
     Nan::SetPrototypeMethod(lcons, "extent", extent);
     Nan::SetPrototypeMethod(lcons, "fields", fields);
 
+    Nan::SetMethod(lcons->GetFunction().As<v8::Object>(),
+                    "create",
+                    Datasource::create);
+
     target->Set(Nan::New("Datasource").ToLocalChecked(), lcons->GetFunction());
     constructor.Reset(lcons);
 }
@@ -95,16 +150,7 @@ NAN_METHOD(Datasource::New)
     v8::Local<v8::Object> options = info[0].As<v8::Object>();
 
     mapnik::parameters params;
-    v8::Local<v8::Array> names = options->GetPropertyNames();
-    unsigned int i = 0;
-    unsigned int a_length = names->Length();
-    while (i < a_length) {
-        v8::Local<v8::Value> name = names->Get(i)->ToString();
-        v8::Local<v8::Value> value = options->Get(name);
-        // TODO - don't treat everything as strings
-        params[TOSTR(name)] = const_cast<char const*>(TOSTR(value));
-        i++;
-    }
+    options_to_params(options, params);
 
     mapnik::datasource_ptr ds;
     try
@@ -150,6 +196,81 @@ v8::Local<v8::Value> Datasource::NewInstance(mapnik::datasource_ptr ds_ptr) {
     return scope.Escape(Nan::New(constructor)->GetFunction()->NewInstance(1, &ext));
 }
 
+/**
+ * Create a datasource on the threadpool. Plugins such as `shape`, `csv` and
+ * `geojson` open, index or parse their file when the datasource is created,
+ * which `new mapnik.Datasource` does on the main thread.
+ *
+ * @name create
+ * @memberof Datasource
+ * @static
+ * @param {Object} options - datasource options, as for `new mapnik.Datasource`
+ * @param {Function} callback - `function(err, datasource)`
+ * @example
+ * mapnik.Datasource.create({type: 'shape', file: 'world.shp'}, function(err, ds) {
+ *   if (err) throw err;
+ *   console.log(ds.extent());
+ * });
+ */
+NAN_METHOD(Datasource::create)
+{
+    if (info.Length() != 2)
+    {
+        Nan::ThrowTypeError("requires two arguments, an object of key:value datasource options and a callback");
+        return;
+    }
+    if (!info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("Must provide an object, eg {type: 'shape', file : 'world.shp'}");
+        return;
+    }
+    if (!info[1]->IsFunction())
+    {
+        Nan::ThrowTypeError("last argument must be a callback function");
+        return;
+    }
+
+    datasource_create_baton_t *closure = new datasource_create_baton_t();
+    closure->request.data = closure;
+    options_to_params(info[0].As<v8::Object>(), closure->params);
+    closure->error = false;
+    closure->cb.Reset(info[1].As<v8::Function>());
+    uv_queue_work(uv_default_loop(), &closure->request, EIO_Create, (uv_after_work_cb)EIO_AfterCreate);
+    return;
+}
+
+void Datasource::EIO_Create(uv_work_t* req)
+{
+    datasource_create_baton_t *closure = static_cast<datasource_create_baton_t *>(req->data);
+    try
+    {
+        closure->ds = mapnik::datasource_cache::instance().create(closure->params);
+    }
+    catch (std::exception const& ex)
+    {
+        closure->error = true;
+        closure->error_name = ex.what();
+    }
+}
+
+void Datasource::EIO_AfterCreate(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    datasource_create_baton_t *closure = static_cast<datasource_create_baton_t *>(req->data);
+    if (closure->error || !closure->ds)
+    {
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error ? closure->error_name.c_str() : "Failed to create datasource") };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    }
+    else
+    {
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), NewInstance(closure->ds) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+    closure->cb.Reset();
+    delete closure;
+}
+
 NAN_METHOD(Datasource::parameters)
 {
     Datasource* d = Nan::ObjectWrap::Unwrap<Datasource>(info.This());
@@ -239,6 +360,8 @@ NAN_METHOD(Datasource::describe)
  * @instance
  * @param {Object} [options]
  * @param {Array<number>} [options.extent=[minx,miny,maxx,maxy]]
+ * @param {Function} [callback] - `function(err, featureset)`, if given the
+ * query is issued to the datasource on the threadpool
  * @returns {Object} an iterator with a `.next()` method that returns
  * features from a dataset.
  * @example
@@ -252,8 +375,16 @@ NAN_METHOD(Datasource::describe)
 NAN_METHOD(Datasource::featureset)
 {
     Datasource* ds = Nan::ObjectWrap::Unwrap<Datasource>(info.Holder());
-    mapnik::box2d<double> extent = ds->datasource_->envelope();
-    if (info.Length() > 0)
+    int args = info.Length();
+    v8::Local<v8::Value> callback;
+    if (args > 0 && info[args - 1]->IsFunction())
+    {
+        callback = info[args - 1];
+        --args;
+    }
+    bool has_extent = false;
+    mapnik::box2d<double> extent;
+    if (args > 0)
     {
         // options object
         if (!info[0]->IsObject())
@@ -288,21 +419,32 @@ NAN_METHOD(Datasource::featureset)
             }
             extent = mapnik::box2d<double>(minx->NumberValue(),miny->NumberValue(),
                                            maxx->NumberValue(),maxy->NumberValue());
+            has_extent = true;
         }
     }
 
+    if (!callback.IsEmpty())
+    {
+        datasource_featureset_baton_t *closure = new datasource_featureset_baton_t();
+        closure->request.data = closure;
+        closure->d = ds;
+        closure->has_extent = has_extent;
+        closure->extent = extent;
+        closure->error = false;
+        closure->cb.Reset(callback.As<v8::Function>());
+        uv_queue_work(uv_default_loop(), &closure->request, EIO_Featureset, (uv_after_work_cb)EIO_AfterFeatureset);
+        ds->Ref();
+        return;
+    }
+
     mapnik::featureset_ptr fs;
     try
     {
-        mapnik::query q(extent);
-        mapnik::layer_descriptor ld = ds->datasource_->get_descriptor();
-        auto const& desc = ld.get_descriptors();
-        for (auto const& attr_info : desc)
+        if (!has_extent)
         {
-            q.add_property_name(attr_info.get_name());
+            extent = ds->datasource_->envelope();
         }
-
-        fs = ds->datasource_->features(q);
+        fs = query_features(ds->datasource_, extent);
     }
     catch (std::exception const& ex)
     {
@@ -326,6 +468,52 @@ NAN_METHOD(Datasource::featureset)
     /* LCOV_EXCL_STOP */
 }
 
+void Datasource::EIO_Featureset(uv_work_t* req)
+{
+    datasource_featureset_baton_t *closure = static_cast<datasource_featureset_baton_t *>(req->data);
+    try
+    {
+        if (!closure->has_extent)
+        {
+            closure->extent = closure->d->datasource_->envelope();
+        }
+        closure->fs = query_features(closure->d->datasource_, closure->extent);
+    }
+    catch (std::exception const& ex)
+    {
+        /* LCOV_EXCL_START */
+        closure->error = true;
+        closure->error_name = ex.what();
+        /* LCOV_EXCL_STOP */
+    }
+}
+
+void Datasource::EIO_AfterFeatureset(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    datasource_featureset_baton_t *closure = static_cast<datasource_featureset_baton_t *>(req->data);
+    if (closure->error)
+    {
+        /* LCOV_EXCL_START */
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+        /* LCOV_EXCL_STOP */
+    }
+    else
+    {
+        v8::Local<v8::Value> result = Nan::Undefined();
+        if (closure->fs && mapnik::is_valid(closure->fs))
+        {
+            result = Featureset::NewInstance(closure->fs);
+        }
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), result };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+    closure->d->Unref();
+    closure->cb.Reset();
+    delete closure;
+}
+
 
 /**
  * Get only the fields metadata from a dataset.
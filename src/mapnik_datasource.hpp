@@ -21,10 +21,15 @@ public:
     static void Initialize(v8::Local<v8::Object> target);
     static NAN_METHOD(New);
     static v8::Local<v8::Value> NewInstance(datasource_ptr ds_ptr);
+    static NAN_METHOD(create);
+    static void EIO_Create(uv_work_t* req);
+    static void EIO_AfterCreate(uv_work_t* req);
 
     static NAN_METHOD(parameters);
     static NAN_METHOD(describe);
     static NAN_METHOD(featureset);
+    static void EIO_Featureset(uv_work_t* req);
+    static void EIO_AfterFeatureset(uv_work_t* req);
     static NAN_METHOD(extent);
     static NAN_METHOD(fields);
 
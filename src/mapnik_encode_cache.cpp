@@ -0,0 +1,420 @@
+#include "mapnik_encode_cache.hpp"
+
+#include <mapnik/image.hpp>
+#include <mapnik/image_view.hpp>
+#include <mapnik/image_util.hpp>        // for is_solid
+#include <mapnik/version.hpp>
+
+// stl
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+namespace node_mapnik {
+
+namespace {
+
+class encode_cache
+{
+public:
+    encode_cache()
+        : capacity_(0),
+          size_(0),
+          hits_(0),
+          misses_(0) {}
+
+    bool enabled() const
+    {
+        return capacity_.load() > 0;
+    }
+
+    bool get(std::string const& key, std::string & out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto itr = index_.find(key);
+        if (itr == index_.end())
+        {
+            ++misses_;
+            return false;
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, itr->second);
+        out = itr->second->second;
+        return true;
+    }
+
+    void put(std::string const& key, std::string const& data)
+    {
+        std::size_t bytes = key.size() + data.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bytes > capacity_.load() || index_.find(key) != index_.end())
+        {
+            return;
+        }
+        entries_.emplace_front(key, data);
+        index_.emplace(key, entries_.begin());
+        size_ += bytes;
+        evict();
+    }
+
+    void resize(std::size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_.store(capacity);
+        evict();
+    }
+
+    void stats(std::size_t & capacity, std::size_t & size, std::size_t & entries,
+               std::size_t & hits, std::size_t & misses)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity = capacity_.load();
+        size = size_;
+        entries = index_.size();
+        hits = hits_;
+        misses = misses_;
+    }
+
+private:
+    // Drops the least recently used entries until the cache fits.
+    void evict()
+    {
+        while (size_ > capacity_.load() && !entries_.empty())
+        {
+            auto const& entry = entries_.back();
+            size_ -= entry.first.size() + entry.second.size();
+            index_.erase(entry.first);
+            entries_.pop_back();
+        }
+    }
+
+    typedef std::list<std::pair<std::string, std::string> > entry_list;
+
+    std::mutex mutex_;
+    std::atomic<std::size_t> capacity_;
+    std::size_t size_;
+    std::size_t hits_;
+    std::size_t misses_;
+    entry_list entries_;
+    std::unordered_map<std::string, entry_list::iterator> index_;
+};
+
+encode_cache & get_encode_cache()
+{
+    static encode_cache cache;
+    return cache;
+}
+
+void append_uint64(std::string & key, std::uint64_t value)
+{
+    key.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+// SipHash-2-4 with 128 bit output (Aumasson and Bernstein), fed
+// incrementally so that image rows with a stride can be hashed in place.
+class siphash128
+{
+public:
+    siphash128(std::uint64_t k0, std::uint64_t k1)
+        : v0_(k0 ^ 0x736f6d6570736575ULL),
+          v1_(k1 ^ 0x646f72616e646f6dULL ^ 0xee),
+          v2_(k0 ^ 0x6c7967656e657261ULL),
+          v3_(k1 ^ 0x7465646279746573ULL),
+          tail_(0),
+          length_(0) {}
+
+    void update(char const* data, std::size_t size)
+    {
+        unsigned char const* bytes = reinterpret_cast<unsigned char const*>(data);
+        std::size_t i = 0;
+        // complete a word left over from an earlier call
+        while ((length_ & 7) != 0 && i < size)
+        {
+            tail_ |= static_cast<std::uint64_t>(bytes[i++]) << (8 * (length_ & 7));
+            if ((++length_ & 7) == 0)
+            {
+                compress(tail_);
+                tail_ = 0;
+            }
+        }
+        for (; i + 8 <= size; i += 8, length_ += 8)
+        {
+            std::uint64_t word = 0;
+            for (int b = 7; b >= 0; --b)
+            {
+                word = (word << 8) | bytes[i + b];
+            }
+            compress(word);
+        }
+        for (; i < size; ++i, ++length_)
+        {
+            tail_ |= static_cast<std::uint64_t>(bytes[i]) << (8 * (length_ & 7));
+        }
+    }
+
+    void finish(std::uint64_t & out0, std::uint64_t & out1)
+    {
+        std::uint64_t b = (static_cast<std::uint64_t>(length_) << 56) | tail_;
+        compress(b);
+        v2_ ^= 0xee;
+        for (int i = 0; i < 4; ++i)
+        {
+            round();
+        }
+        out0 = v0_ ^ v1_ ^ v2_ ^ v3_;
+        v1_ ^= 0xdd;
+        for (int i = 0; i < 4; ++i)
+        {
+            round();
+        }
+        out1 = v0_ ^ v1_ ^ v2_ ^ v3_;
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    void round()
+    {
+        v0_ += v1_; v1_ = rotl(v1_, 13); v1_ ^= v0_; v0_ = rotl(v0_, 32);
+        v2_ += v3_; v3_ = rotl(v3_, 16); v3_ ^= v2_;
+        v0_ += v3_; v3_ = rotl(v3_, 21); v3_ ^= v0_;
+        v2_ += v1_; v1_ = rotl(v1_, 17); v1_ ^= v2_; v2_ = rotl(v2_, 32);
+    }
+
+    void compress(std::uint64_t m)
+    {
+        v3_ ^= m;
+        round();
+        round();
+        v0_ ^= m;
+    }
+
+    std::uint64_t v0_;
+    std::uint64_t v1_;
+    std::uint64_t v2_;
+    std::uint64_t v3_;
+    std::uint64_t tail_;
+    std::size_t length_;
+};
+
+// The hash key is drawn once per process, so that images whose hashes
+// collide cannot be crafted ahead of time.
+void hash_key(std::uint64_t & k0, std::uint64_t & k1)
+{
+    static std::uint64_t const* key = []() {
+        static std::uint64_t k[2];
+        std::random_device rd;
+        for (std::uint64_t & part : k)
+        {
+            part = (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+        }
+        return k;
+    }();
+    k0 = key[0];
+    k1 = key[1];
+}
+
+// Appends the pixel of a solid image, or the SipHash-2-4-128 of all pixels,
+// to the key. Entries are not checked against the pixels on a hit, so the
+// hash has to be one whose 128 bit output behaves like a random function.
+struct pixel_key_visitor
+{
+    pixel_key_visitor(bool solid, std::string & key)
+        : solid_(solid),
+          key_(key) {}
+
+    bool operator() (mapnik::image_null const&) const
+    {
+        return false;
+    }
+
+    bool operator() (mapnik::image_view_null const&) const
+    {
+        return false;
+    }
+
+    template <typename T>
+    bool operator() (T const& image) const
+    {
+        std::size_t pixel_size = sizeof(typename T::pixel_type);
+        if (solid_)
+        {
+            key_.push_back('s');
+            key_.append(reinterpret_cast<char const*>(image.get_row(0)), pixel_size);
+            return true;
+        }
+        std::size_t row_size = image.width() * pixel_size;
+        std::uint64_t k0, k1;
+        hash_key(k0, k1);
+        siphash128 hash(k0, k1);
+        for (std::size_t y = 0; y < image.height(); ++y)
+        {
+            hash.update(reinterpret_cast<char const*>(image.get_row(y)), row_size);
+        }
+        std::uint64_t h0, h1;
+        hash.finish(h0, h1);
+        key_.push_back('h');
+        append_uint64(key_, h0);
+        append_uint64(key_, h1);
+        return true;
+    }
+
+private:
+    bool solid_;
+    std::string & key_;
+};
+
+template <typename Image>
+bool cache_lookup(Image const& image,
+                  std::string const& format,
+                  mapnik::rgba_palette const* palette,
+                  std::string & key,
+                  std::string & out)
+{
+    encode_cache & cache = get_encode_cache();
+    if (!cache.enabled() || image.width() == 0 || image.height() == 0)
+    {
+        return false;
+    }
+    std::string k;
+    append_uint64(k, format.size());
+    k.append(format);
+    if (palette)
+    {
+        std::vector<mapnik::rgb> const& colors = palette->palette();
+        #if MAPNIK_VERSION >= 300012
+        std::vector<unsigned> const& alpha = palette->alpha_table();
+        #else
+        std::vector<unsigned> const& alpha = palette->alphaTable();
+        #endif
+        append_uint64(k, colors.size());
+        for (std::size_t i = 0; i < colors.size(); ++i)
+        {
+            k.push_back(static_cast<char>(colors[i].r));
+            k.push_back(static_cast<char>(colors[i].g));
+            k.push_back(static_cast<char>(colors[i].b));
+            k.push_back(static_cast<char>(i < alpha.size() ? alpha[i] : 0xff));
+        }
+    }
+    else
+    {
+        append_uint64(k, 0xffffffffffffffffULL);
+    }
+    append_uint64(k, static_cast<std::uint64_t>(image.get_dtype()));
+    append_uint64(k, image.get_premultiplied() ? 1 : 0);
+    append_uint64(k, image.width());
+    append_uint64(k, image.height());
+    if (!mapnik::util::apply_visitor(pixel_key_visitor(mapnik::is_solid(image), k), image))
+    {
+        return false;
+    }
+    if (cache.get(k, out))
+    {
+        return true;
+    }
+    key = std::move(k);
+    return false;
+}
+
+} // end anonymous ns
+
+bool encode_cache_lookup(mapnik::image_any const& image,
+                         std::string const& format,
+                         mapnik::rgba_palette const* palette,
+                         std::string & key,
+                         std::string & out)
+{
+    return cache_lookup(image, format, palette, key, out);
+}
+
+bool encode_cache_lookup(mapnik::image_view_any const& image,
+                         std::string const& format,
+                         mapnik::rgba_palette const* palette,
+                         std::string & key,
+                         std::string & out)
+{
+    return cache_lookup(image, format, palette, key, out);
+}
+
+void encode_cache_insert(std::string const& key, std::string const& data)
+{
+    if (!key.empty())
+    {
+        get_encode_cache().put(key, data);
+    }
+}
+
+/**
+ * Keep the output of `Image.encode`, `Image.encodeSync`, `ImageView.encode`
+ * and `ImageView.encodeSync` in a cache so that encoding an image with the
+ * same pixels, format and palette again returns the earlier result instead
+ * of encoding it. Solid images are matched by their color, others by a
+ * 128 bit SipHash-2-4 of their pixels, keyed randomly per process. The least recently used results are dropped once the
+ * cache holds more than `size` bytes. The cache is disabled by default and
+ * setting `size` to `0` disables and empties it.
+ *
+ * @name setEncodeCache
+ * @memberof mapnik
+ * @static
+ * @param {Object} options
+ * @param {number} options.size - maximum number of bytes kept in the cache
+ * @example
+ * mapnik.setEncodeCache({size: 64 * 1024 * 1024});
+ */
+NAN_METHOD(setEncodeCache)
+{
+    if (info.Length() != 1 || !info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("requires an options object, eg. {size: 67108864}");
+        return;
+    }
+    v8::Local<v8::Object> options = info[0]->ToObject();
+    v8::Local<v8::String> param = Nan::New("size").ToLocalChecked();
+    if (!options->Has(param))
+    {
+        Nan::ThrowTypeError("option 'size' is required");
+        return;
+    }
+    v8::Local<v8::Value> param_val = options->Get(param);
+    if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+    {
+        Nan::ThrowTypeError("option 'size' must be a non-negative integer");
+        return;
+    }
+    get_encode_cache().resize(static_cast<std::size_t>(param_val->IntegerValue()));
+    return;
+}
+
+/**
+ * Report the state of the cache set up with `mapnik.setEncodeCache`.
+ *
+ * @name encodeCacheStats
+ * @memberof mapnik
+ * @static
+ * @returns {Object} `size` (the limit in bytes), `bytes` and `entries`
+ * currently held, and the number of `hits` and `misses` so far
+ * @example
+ * var stats = mapnik.encodeCacheStats();
+ * console.log(stats.hits / (stats.hits + stats.misses));
+ */
+NAN_METHOD(encodeCacheStats)
+{
+    std::size_t capacity, size, entries, hits, misses;
+    get_encode_cache().stats(capacity, size, entries, hits, misses);
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    stats->Set(Nan::New("size").ToLocalChecked(), Nan::New<v8::Number>(capacity));
+    stats->Set(Nan::New("bytes").ToLocalChecked(), Nan::New<v8::Number>(size));
+    stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New<v8::Number>(entries));
+    stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New<v8::Number>(hits));
+    stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New<v8::Number>(misses));
+    info.GetReturnValue().Set(stats);
+}
+
+} // end ns
@@ -0,0 +1,47 @@
+#ifndef __NODE_MAPNIK_ENCODE_CACHE_H__
+#define __NODE_MAPNIK_ENCODE_CACHE_H__
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wshadow"
+#include <nan.h>
+#pragma GCC diagnostic pop
+
+#include <mapnik/image_any.hpp>
+#include <mapnik/image_view_any.hpp>
+#include <mapnik/palette.hpp>
+
+// stl
+#include <string>
+
+namespace node_mapnik {
+
+// Process wide cache of encoded images, keyed by the pixels of the image
+// together with the format string and palette, and bounded in bytes. It is
+// disabled until `mapnik.setEncodeCache` gives it a size.
+//
+// Returns true and fills `out` when an identical image was encoded before.
+// Otherwise `key` is set to the key the result should be stored under with
+// `encode_cache_insert`; it is left empty when the cache is disabled or the
+// image cannot be cached.
+bool encode_cache_lookup(mapnik::image_any const& image,
+                         std::string const& format,
+                         mapnik::rgba_palette const* palette,
+                         std::string & key,
+                         std::string & out);
+bool encode_cache_lookup(mapnik::image_view_any const& image,
+                         std::string const& format,
+                         mapnik::rgba_palette const* palette,
+                         std::string & key,
+                         std::string & out);
+
+// Stores an encoded image under a key from `encode_cache_lookup`; does
+// nothing when the key is empty.
+void encode_cache_insert(std::string const& key, std::string const& data);
+
+NAN_METHOD(setEncodeCache);
+NAN_METHOD(encodeCacheStats);
+
+} // end ns
+
+#endif
@@ -1,6 +1,13 @@
+#include "utils.hpp"
 #include "mapnik_featureset.hpp"
 #include "mapnik_feature.hpp"
 
+// mapnik
+#include <mapnik/util/feature_to_geojson.hpp>
+
+// stl
+#include <stdexcept>
+
 Nan::Persistent<v8::FunctionTemplate> Featureset::constructor;
 
 /**
@@ -19,6 +26,8 @@ void Featureset::Initialize(v8::Local<v8::Object> target) {
     lcons->SetClassName(Nan::New("Featureset").ToLocalChecked());
 
     Nan::SetPrototypeMethod(lcons, "next", next);
+    Nan::SetPrototypeMethod(lcons, "nextBatch", nextBatch);
+    Nan::SetPrototypeMethod(lcons, "toArray", toArray);
 
     target->Set(Nan::New("Featureset").ToLocalChecked(), lcons->GetFunction());
     constructor.Reset(lcons);
@@ -26,12 +35,26 @@ void Featureset::Initialize(v8::Local<v8::Object> target) {
 
 Featureset::Featureset() :
     Nan::ObjectWrap(),
-    this_() {}
+    this_(),
+    in_use_(false) {}
 
 Featureset::~Featureset()
 {
 }
 
+bool Featureset::acquire() {
+    if (in_use_)
+    {
+        return false;
+    }
+    in_use_ = true;
+    return true;
+}
+
+void Featureset::release() {
+    in_use_ = false;
+}
+
 NAN_METHOD(Featureset::New)
 {
     if (!info.IsConstructCall())
@@ -66,6 +89,11 @@ NAN_METHOD(Featureset::New)
 NAN_METHOD(Featureset::next)
 {
     Featureset* fs = Nan::ObjectWrap::Unwrap<Featureset>(info.Holder());
+    if (fs->in_use_)
+    {
+        Nan::ThrowError("Featureset currently in use by an asynchronous nextBatch or toArray call");
+        return;
+    }
     if (fs->this_) {
         mapnik::feature_ptr fp;
         try
@@ -92,6 +120,298 @@ NAN_METHOD(Featureset::next)
     return;
 }
 
+namespace {
+
+enum batch_format
+{
+    BATCH_FEATURES,
+    BATCH_GEOJSON,
+    BATCH_NDJSON
+};
+
+// Reads up to `count` features, or all remaining ones when `count` is 0.
+// They are kept in `features`, or written to `json` as a FeatureCollection
+// or as one GeoJSON Feature per line. Returns the number of features read.
+std::size_t read_batch(mapnik::featureset_ptr const& fs,
+                       std::size_t count,
+                       batch_format format,
+                       std::vector<mapnik::feature_ptr> & features,
+                       std::string & json)
+{
+    std::size_t num = 0;
+    if (format == BATCH_GEOJSON)
+    {
+        json = "{\"type\":\"FeatureCollection\",\"features\":[";
+    }
+    mapnik::feature_ptr fp;
+    while (fs && (count == 0 || num < count) && (fp = fs->next()))
+    {
+        if (format == BATCH_FEATURES)
+        {
+            features.push_back(fp);
+        }
+        else
+        {
+            std::string feature_json;
+            if (!mapnik::util::to_geojson(feature_json, *fp))
+            {
+                /* LCOV_EXCL_START */
+                throw std::runtime_error("Failed to generate GeoJSON");
+                /* LCOV_EXCL_STOP */
+            }
+            if (format == BATCH_GEOJSON && num > 0)
+            {
+                json.push_back(',');
+            }
+            json += feature_json;
+            if (format == BATCH_NDJSON)
+            {
+                json.push_back('\n');
+            }
+        }
+        ++num;
+    }
+    if (format == BATCH_GEOJSON)
+    {
+        json += "]}";
+    }
+    return num;
+}
+
+// Turns a batch into an Array of Features or a Buffer of JSON. `nextBatch`
+// returns null instead once the featureset is exhausted.
+v8::Local<v8::Value> batch_result(std::vector<mapnik::feature_ptr> const& features,
+                                  std::unique_ptr<std::string> & json,
+                                  std::size_t num,
+                                  batch_format format,
+                                  bool to_array)
+{
+    Nan::EscapableHandleScope scope;
+    if (num == 0 && !to_array)
+    {
+        return scope.Escape(Nan::Null());
+    }
+    if (format == BATCH_FEATURES)
+    {
+        v8::Local<v8::Array> a = Nan::New<v8::Array>(features.size());
+        for (unsigned i = 0; i < features.size(); ++i)
+        {
+            a->Set(i, Feature::NewInstance(features[i]));
+        }
+        return scope.Escape(a);
+    }
+    std::string * str = json.release();
+    return scope.Escape(Nan::NewBuffer(&(*str)[0],
+                                       str->size(),
+                                       node_mapnik::delete_buffer_owner<std::string>,
+                                       str).ToLocalChecked());
+}
+
+typedef struct {
+    uv_work_t request;
+    Featureset* fs;
+    std::size_t count;
+    batch_format format;
+    bool to_array;
+    std::vector<mapnik::feature_ptr> features;
+    std::unique_ptr<std::string> json;
+    std::size_t num;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+} featureset_batch_baton_t;
+
+} // end anonymous ns
+
+/**
+ * Read up to `count` features at once. This avoids a call into the
+ * featureset for every feature when exporting many of them. If a callback
+ * is given the features are read from the datasource on the threadpool.
+ *
+ * @name nextBatch
+ * @instance
+ * @memberof Featureset
+ * @param {number} count - maximum number of features to read, a positive integer
+ * @param {Object} [options]
+ * @param {string} [options.format='features'] - `features` for an Array of
+ * {@link mapnik.Feature} objects, `geojson` for a Buffer holding a GeoJSON
+ * FeatureCollection or `ndjson` for a Buffer holding one GeoJSON Feature per line
+ * @param {Function} [callback] - `function(err, batch)`, read asynchronously
+ * @returns {Array<mapnik.Feature>|Buffer|null} the features, or `null` once
+ * the featureset has no features left
+ * @example
+ * var batch;
+ * while ((batch = featureset.nextBatch(1000))) {
+ *   batch.forEach(function(feature) { console.log(feature.id()); });
+ * }
+ */
+NAN_METHOD(Featureset::nextBatch)
+{
+    _batch(info, false);
+}
+
+/**
+ * Read all remaining features at once, see `nextBatch`.
+ *
+ * @name toArray
+ * @instance
+ * @memberof Featureset
+ * @param {Object} [options]
+ * @param {string} [options.format='features'] - `features`, `geojson` or `ndjson`
+ * @param {Function} [callback] - `function(err, features)`, read asynchronously
+ * @returns {Array<mapnik.Feature>|Buffer} the features, empty when none are left
+ * @example
+ * featureset.toArray({format: 'ndjson'}, function(err, buffer) {
+ *   if (err) throw err;
+ *   fs.writeFileSync('features.ndjson', buffer);
+ * });
+ */
+NAN_METHOD(Featureset::toArray)
+{
+    _batch(info, true);
+}
+
+void Featureset::_batch(Nan::NAN_METHOD_ARGS_TYPE info, bool to_array)
+{
+    Featureset* fs = Nan::ObjectWrap::Unwrap<Featureset>(info.Holder());
+    int args = info.Length();
+    v8::Local<v8::Value> callback;
+    if (args > 0 && info[args - 1]->IsFunction())
+    {
+        callback = info[args - 1];
+        --args;
+    }
+
+    int arg = 0;
+    std::size_t count = 0;
+    if (!to_array)
+    {
+        if (args < 1 || !info[0]->IsNumber() || info[0]->IntegerValue() < 1)
+        {
+            Nan::ThrowTypeError("first argument must be a positive integer, the number of features to read");
+            return;
+        }
+        count = info[0]->IntegerValue();
+        ++arg;
+    }
+
+    batch_format format = BATCH_FEATURES;
+    if (args > arg)
+    {
+        if (!info[arg]->IsObject())
+        {
+            Nan::ThrowTypeError("optional argument must be an options object");
+            return;
+        }
+        v8::Local<v8::Object> options = info[arg]->ToObject();
+        if (options->Has(Nan::New("format").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("format").ToLocalChecked());
+            std::string format_name = param_val->IsString() ? TOSTR(param_val) : "";
+            if (format_name == "features")
+            {
+                format = BATCH_FEATURES;
+            }
+            else if (format_name == "geojson")
+            {
+                format = BATCH_GEOJSON;
+            }
+            else if (format_name == "ndjson")
+            {
+                format = BATCH_NDJSON;
+            }
+            else
+            {
+                Nan::ThrowTypeError("option 'format' must be one of the following strings: features, geojson, ndjson");
+                return;
+            }
+        }
+    }
+
+    if (!fs->acquire())
+    {
+        Nan::ThrowError("Featureset currently in use by an asynchronous nextBatch or toArray call");
+        return;
+    }
+
+    if (callback.IsEmpty())
+    {
+        std::vector<mapnik::feature_ptr> features;
+        std::unique_ptr<std::string> json(new std::string());
+        std::size_t num = 0;
+        try
+        {
+            num = read_batch(fs->this_, count, format, features, *json);
+        }
+        catch (std::exception const& ex)
+        {
+            fs->release();
+            Nan::ThrowError(ex.what());
+            return;
+        }
+        fs->release();
+        info.GetReturnValue().Set(batch_result(features, json, num, format, to_array));
+        return;
+    }
+
+    featureset_batch_baton_t *closure = new featureset_batch_baton_t();
+    closure->request.data = closure;
+    closure->fs = fs;
+    closure->count = count;
+    closure->format = format;
+    closure->to_array = to_array;
+    closure->json.reset(new std::string());
+    closure->num = 0;
+    closure->error = false;
+    closure->cb.Reset(callback.As<v8::Function>());
+    uv_queue_work(uv_default_loop(), &closure->request, EIO_Batch, (uv_after_work_cb)EIO_AfterBatch);
+    fs->Ref();
+    return;
+}
+
+void Featureset::EIO_Batch(uv_work_t* req)
+{
+    featureset_batch_baton_t *closure = static_cast<featureset_batch_baton_t *>(req->data);
+    try
+    {
+        closure->num = read_batch(closure->fs->this_,
+                                  closure->count,
+                                  closure->format,
+                                  closure->features,
+                                  *closure->json);
+    }
+    catch (std::exception const& ex)
+    {
+        closure->error = true;
+        closure->error_name = ex.what();
+    }
+}
+
+void Featureset::EIO_AfterBatch(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    featureset_batch_baton_t *closure = static_cast<featureset_batch_baton_t *>(req->data);
+    closure->fs->release();
+    if (closure->error)
+    {
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    }
+    else
+    {
+        v8::Local<v8::Value> result = batch_result(closure->features,
+                                                   closure->json,
+                                                   closure->num,
+                                                   closure->format,
+                                                   closure->to_array);
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), result };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+    closure->fs->Unref();
+    closure->cb.Reset();
+    delete closure;
+}
+
 v8::Local<v8::Value> Featureset::NewInstance(mapnik::featureset_ptr fsp)
 {
     Nan::EscapableHandleScope scope;
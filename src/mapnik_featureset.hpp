@@ -9,6 +9,8 @@
 
 #include <mapnik/featureset.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
 
 
@@ -21,12 +23,20 @@ public:
     static NAN_METHOD(New);
     static v8::Local<v8::Value> NewInstance(mapnik::featureset_ptr fs_ptr);
     static NAN_METHOD(next);
+    static NAN_METHOD(nextBatch);
+    static NAN_METHOD(toArray);
+    static void _batch(Nan::NAN_METHOD_ARGS_TYPE info, bool to_array);
+    static void EIO_Batch(uv_work_t* req);
+    static void EIO_AfterBatch(uv_work_t* req);
 
     Featureset();
+    bool acquire();
+    void release();
 
 private:
     ~Featureset();
     fs_ptr this_;
+    bool in_use_;
 };
 
 #endif
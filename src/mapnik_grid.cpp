@@ -339,6 +339,9 @@ NAN_METHOD(Grid::view)
  * @instance
  * @name encodeSync
  * @param {Object} [options={ resolution: 4, features: false }]
+ * @param {boolean} [options.buffer=false] - return the UTFGrid already
+ * serialized as JSON in a Buffer instead of an object. `encode` then does
+ * all of the work off the main thread.
  * @returns {Object} an encoded field with `grid`, `keys`, and `data` members.
  */
 NAN_METHOD(Grid::encodeSync)
@@ -348,6 +351,7 @@ NAN_METHOD(Grid::encodeSync)
     // defaults
     unsigned int resolution = 4;
     bool add_features = true;
+    bool as_buffer = false;
 
     // options hash
     if (info.Length() >= 1) {
@@ -387,6 +391,18 @@ NAN_METHOD(Grid::encodeSync)
 
             add_features = bind_opt->BooleanValue();
         }
+
+        if (options->Has(Nan::New("buffer").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer").ToLocalChecked());
+            if (!bind_opt->IsBoolean())
+            {
+                Nan::ThrowTypeError("'buffer' must be an Boolean");
+                return;
+            }
+
+            as_buffer = bind_opt->BooleanValue();
+        }
     }
 
     try {
@@ -395,6 +411,21 @@ NAN_METHOD(Grid::encodeSync)
         std::vector<mapnik::grid::lookup_type> key_order;
         node_mapnik::grid2utf<mapnik::grid>(*g->get(),lines,key_order,resolution);
 
+        if (as_buffer)
+        {
+            node_mapnik::grid_features features;
+            if (add_features) {
+                node_mapnik::gather_features<mapnik::grid>(*g->get(),key_order,features);
+            }
+            std::string * json = new std::string();
+            node_mapnik::grid2json<mapnik::grid>(*g->get(),lines,key_order,resolution,features,*json);
+            info.GetReturnValue().Set(Nan::NewBuffer(&(*json)[0],
+                                                     json->size(),
+                                                     node_mapnik::delete_buffer_owner<std::string>,
+                                                     json).ToLocalChecked());
+            return;
+        }
+
         // convert key order to proper javascript array
         v8::Local<v8::Array> keys_a = Nan::New<v8::Array>(key_order.size());
         std::vector<std::string>::iterator it;
@@ -449,7 +480,10 @@ typedef struct {
     std::vector<node_mapnik::grid_line_type> lines;
     unsigned int resolution;
     bool add_features;
+    bool as_buffer;
     std::vector<mapnik::grid::lookup_type> key_order;
+    node_mapnik::grid_features features;
+    std::string json;
 } encode_grid_baton_t;
 
 NAN_METHOD(Grid::encode)
@@ -459,6 +493,7 @@ NAN_METHOD(Grid::encode)
     // defaults
     unsigned int resolution = 4;
     bool add_features = true;
+    bool as_buffer = false;
 
     // options hash
     if (info.Length() >= 1) {
@@ -498,6 +533,18 @@ NAN_METHOD(Grid::encode)
 
             add_features = bind_opt->BooleanValue();
         }
+
+        if (options->Has(Nan::New("buffer").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer").ToLocalChecked());
+            if (!bind_opt->IsBoolean())
+            {
+                Nan::ThrowTypeError("'buffer' must be an Boolean");
+                return;
+            }
+
+            as_buffer = bind_opt->BooleanValue();
+        }
     }
 
     // ensure callback is a function
@@ -514,6 +561,7 @@ NAN_METHOD(Grid::encode)
     closure->error = false;
     closure->resolution = resolution;
     closure->add_features = add_features;
+    closure->as_buffer = as_buffer;
     closure->cb.Reset(callback.As<v8::Function>());
     // todo - reserve lines size?
     uv_queue_work(uv_default_loop(), &closure->request, EIO_Encode, (uv_after_work_cb)EIO_AfterEncode);
@@ -531,6 +579,21 @@ void Grid::EIO_Encode(uv_work_t* req)
                                             closure->lines,
                                             closure->key_order,
                                             closure->resolution);
+        if (closure->add_features)
+        {
+            node_mapnik::gather_features<mapnik::grid>(*closure->g->get(),
+                                                       closure->key_order,
+                                                       closure->features);
+        }
+        if (closure->as_buffer)
+        {
+            node_mapnik::grid2json<mapnik::grid>(*closure->g->get(),
+                                                 closure->lines,
+                                                 closure->key_order,
+                                                 closure->resolution,
+                                                 closure->features,
+                                                 closure->json);
+        }
     }
     catch (std::exception const& ex)
     {
@@ -559,6 +622,16 @@ void Grid::EIO_AfterEncode(uv_work_t* req)
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
         /* LCOV_EXCL_STOP */
     } 
+    else if (closure->as_buffer)
+    {
+        std::string * json = new std::string(std::move(closure->json));
+        v8::Local<v8::Value> argv[2] = { Nan::Null(),
+                                         Nan::NewBuffer(&(*json)[0],
+                                                        json->size(),
+                                                        node_mapnik::delete_buffer_owner<std::string>,
+                                                        json).ToLocalChecked() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
     else 
     {
 
@@ -572,13 +645,9 @@ void Grid::EIO_AfterEncode(uv_work_t* req)
         }
 
         mapnik::grid const& grid_type = *closure->g->get();
-        // gather feature data
+        // feature data gathered in the worker
         v8::Local<v8::Object> feature_data = Nan::New<v8::Object>();
-        if (closure->add_features) {
-            node_mapnik::write_features<mapnik::grid>(grid_type,
-                                                      feature_data,
-                                                      closure->key_order);
-        }
+        node_mapnik::write_features(closure->features, feature_data);
 
         // Create the return hash.
         v8::Local<v8::Object> json = Nan::New<v8::Object>();
@@ -280,6 +280,7 @@ NAN_METHOD(GridView::encodeSync)
     // defaults
     unsigned int resolution = 4;
     bool add_features = true;
+    bool as_buffer = false;
 
     // options hash
     if (info.Length() >= 1) {
@@ -320,6 +321,18 @@ NAN_METHOD(GridView::encodeSync)
 
             add_features = bind_opt->BooleanValue();
         }
+
+        if (options->Has(Nan::New("buffer").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer").ToLocalChecked());
+            if (!bind_opt->IsBoolean())
+            {
+                Nan::ThrowTypeError("'buffer' must be an Boolean");
+                return;
+            }
+
+            as_buffer = bind_opt->BooleanValue();
+        }
     }
 
     try {
@@ -328,6 +341,21 @@ NAN_METHOD(GridView::encodeSync)
         std::vector<mapnik::grid_view::lookup_type> key_order;
         node_mapnik::grid2utf<mapnik::grid_view>(*g->get(),lines,key_order,resolution);
 
+        if (as_buffer)
+        {
+            node_mapnik::grid_features features;
+            if (add_features) {
+                node_mapnik::gather_features<mapnik::grid_view>(*g->get(),key_order,features);
+            }
+            std::string * json = new std::string();
+            node_mapnik::grid2json<mapnik::grid_view>(*g->get(),lines,key_order,resolution,features,*json);
+            info.GetReturnValue().Set(Nan::NewBuffer(&(*json)[0],
+                                                     json->size(),
+                                                     node_mapnik::delete_buffer_owner<std::string>,
+                                                     json).ToLocalChecked());
+            return;
+        }
+
         // convert key order to proper javascript array
         v8::Local<v8::Array> keys_a = Nan::New<v8::Array>(key_order.size());
         std::vector<std::string>::iterator it;
@@ -383,7 +411,10 @@ typedef struct {
     std::vector<node_mapnik::grid_line_type> lines;
     unsigned int resolution;
     bool add_features;
+    bool as_buffer;
     std::vector<mapnik::grid::lookup_type> key_order;
+    node_mapnik::grid_features features;
+    std::string json;
 } encode_grid_view_baton_t;
 
 
@@ -394,6 +425,7 @@ NAN_METHOD(GridView::encode)
     // defaults
     unsigned int resolution = 4;
     bool add_features = true;
+    bool as_buffer = false;
 
     // options hash
     if (info.Length() >= 1) {
@@ -434,6 +466,18 @@ NAN_METHOD(GridView::encode)
 
             add_features = bind_opt->BooleanValue();
         }
+
+        if (options->Has(Nan::New("buffer").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer").ToLocalChecked());
+            if (!bind_opt->IsBoolean())
+            {
+                Nan::ThrowTypeError("'buffer' must be an Boolean");
+                return;
+            }
+
+            as_buffer = bind_opt->BooleanValue();
+        }
     }
 
     // ensure callback is a function
@@ -450,6 +494,7 @@ NAN_METHOD(GridView::encode)
     closure->error = false;
     closure->resolution = resolution;
     closure->add_features = add_features;
+    closure->as_buffer = as_buffer;
     closure->cb.Reset(callback);
     uv_queue_work(uv_default_loop(), &closure->request, EIO_Encode, (uv_after_work_cb)EIO_AfterEncode);
     g->Ref();
@@ -462,11 +507,25 @@ void GridView::EIO_Encode(uv_work_t* req)
 
     try
     {
-        // TODO - write features and clear here as well?
         node_mapnik::grid2utf<mapnik::grid_view>(*(closure->g->get()),
                                                  closure->lines,
                                                  closure->key_order,
                                                  closure->resolution);
+        if (closure->add_features)
+        {
+            node_mapnik::gather_features<mapnik::grid_view>(*(closure->g->get()),
+                                                            closure->key_order,
+                                                            closure->features);
+        }
+        if (closure->as_buffer)
+        {
+            node_mapnik::grid2json<mapnik::grid_view>(*(closure->g->get()),
+                                                      closure->lines,
+                                                      closure->key_order,
+                                                      closure->resolution,
+                                                      closure->features,
+                                                      closure->json);
+        }
     }
     catch (std::exception const& ex)
     {
@@ -493,6 +552,16 @@ void GridView::EIO_AfterEncode(uv_work_t* req)
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
         /* LCOV_EXCL_STOP */
     }
+    else if (closure->as_buffer)
+    {
+        std::string * json = new std::string(std::move(closure->json));
+        v8::Local<v8::Value> argv[2] = { Nan::Null(),
+                                         Nan::NewBuffer(&(*json)[0],
+                                                        json->size(),
+                                                        node_mapnik::delete_buffer_owner<std::string>,
+                                                        json).ToLocalChecked() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
     else
     {
         // convert key order to proper javascript array
@@ -506,13 +575,9 @@ void GridView::EIO_AfterEncode(uv_work_t* req)
 
         mapnik::grid_view const& grid_type = *(closure->g->get());
 
-        // gather feature data
+        // feature data gathered in the worker
         v8::Local<v8::Object> feature_data = Nan::New<v8::Object>();
-        if (closure->add_features) {
-            node_mapnik::write_features<mapnik::grid_view>(grid_type,
-                                                           feature_data,
-                                                           closure->key_order);
-        }
+        node_mapnik::write_features(closure->features, feature_data);
         // Create the return hash.
         v8::Local<v8::Object> json = Nan::New<v8::Object>();
         v8::Local<v8::Array> grid_array = Nan::New<v8::Array>(closure->lines.size());
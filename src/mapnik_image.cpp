@@ -24,8 +24,11 @@
 
 #include "mapnik_image.hpp"
 #include "mapnik_image_view.hpp"
+#include "mapnik_image_encode.hpp"
+#include "mapnik_encode_cache.hpp"
 #include "mapnik_palette.hpp"
 #include "mapnik_color.hpp"
+#include "mapnik_thread_pool.hpp"
 
 #include "utils.hpp"
 
@@ -148,18 +151,40 @@ void Image::Initialize(v8::Local<v8::Object> target) {
 
 Image::Image(unsigned int width, unsigned int height, mapnik::image_dtype type, bool initialized, bool premultiplied, bool painted) :
     Nan::ObjectWrap(),
-    this_(std::make_shared<mapnik::image_any>(width,height,type,initialized,premultiplied,painted))
+    this_(std::make_shared<mapnik::image_any>(width,height,type,initialized,premultiplied,painted)),
+    data_view_()
 {
 }
 
 Image::Image(image_ptr _this) :
     Nan::ObjectWrap(),
-    this_(_this)
+    this_(_this),
+    data_view_()
 {
 }
 
 Image::~Image()
 {
+    data_view_.Reset();
+}
+
+v8::Local<v8::Object> Image::data_view()
+{
+    Nan::EscapableHandleScope scope;
+    if (data_view_.IsEmpty())
+    {
+        // The buffer aliases the pixel storage and holds its own reference to
+        // it, so the memory stays valid even if the Image is collected first.
+        // It is created once and cached because the same memory can not be
+        // handed to v8 as more than one external buffer; images made by
+        // `fromBufferSync` start out with their source buffer here instead.
+        v8::Local<v8::Object> buffer = Nan::NewBuffer(reinterpret_cast<char *>(this_->bytes()),
+                                                      this_->size(),
+                                                      node_mapnik::delete_buffer_owner<image_ptr>,
+                                                      new image_ptr(this_)).ToLocalChecked();
+        data_view_.Reset(buffer);
+    }
+    return scope.Escape(Nan::New(data_view_));
 }
 
 NAN_METHOD(Image::New)
@@ -3283,6 +3308,10 @@ v8::Local<v8::Value> Image::_fromBufferSync(Nan::NAN_METHOD_ARGS_TYPE info)
         mapnik::image_rgba8 im_wrapper(width, height, reinterpret_cast<unsigned char*>(node::Buffer::Data(obj)), premultiplied, painted);
         image_ptr imagep = std::make_shared<mapnik::image_any>(im_wrapper);
         Image* im = new Image(imagep);
+        // The pixels are the memory of `obj`, which v8 already tracks, so
+        // `data({copy:false})` must return `obj` itself rather than wrap the
+        // same memory in another external buffer.
+        im->data_view_.Reset(obj);
         v8::Local<v8::Value> ext = Nan::New<v8::External>(im);
         v8::Local<v8::Value> image_instance = Nan::New(constructor)->GetFunction()->NewInstance(1, &ext);
         v8::Local<v8::Object> image_obj = image_instance->ToObject();
@@ -3524,6 +3553,9 @@ void Image::EIO_AfterFromBytes(uv_work_t* req)
  * @param {string} [format=png] image format
  * @param {Object} [options]
  * @param {mapnik.Palette} [options.palette] - mapnik.Palette object
+ * @param {number} [options.threads=1] - encode truecolor PNG (`png32`, `png24`)
+ * and WebP on up to this many threads of a pool shared by all encodes. Other
+ * formats are encoded on one thread.
  * @returns {Buffer} buffer - encoded image data
  * @instance
  * @memberof Image
@@ -3539,6 +3571,7 @@ NAN_METHOD(Image::encodeSync)
 
     std::string format = "png";
     palette_ptr palette;
+    unsigned threads = 1;
 
     // accept custom format
     if (info.Length() >= 1){
@@ -3572,16 +3605,32 @@ NAN_METHOD(Image::encodeSync)
             }
             palette = Nan::ObjectWrap::Unwrap<Palette>(obj)->palette();
         }
+
+        if (options->Has(Nan::New("threads").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> threads_val = options->Get(Nan::New("threads").ToLocalChecked());
+            if (!threads_val->IsNumber() || threads_val->IntegerValue() < 0) {
+                Nan::ThrowTypeError("'threads' must be a non-negative integer");
+                return;
+            }
+            threads = threads_val->IntegerValue();
+        }
     }
 
     try {
         std::string s;
-        if (palette.get())
+        std::string key;
+        if (!node_mapnik::encode_cache_lookup(*(im->this_), format, palette.get(), key, s))
         {
-            s = save_to_string(*(im->this_), format, *palette);
-        }
-        else {
-            s = save_to_string(*(im->this_), format);
+            if (palette.get())
+            {
+                s = save_to_string(*(im->this_), format, *palette);
+            }
+            else if (!node_mapnik::encode_parallel(*(im->this_), format, threads, s))
+            {
+                s = save_to_string(*(im->this_), format);
+            }
+            node_mapnik::encode_cache_insert(key, s);
         }
 
         info.GetReturnValue().Set(Nan::CopyBuffer((char*)s.data(), s.size()).ToLocalChecked());
@@ -3598,6 +3647,7 @@ typedef struct {
     Image* im;
     std::string format;
     palette_ptr palette;
+    unsigned threads;
     bool error;
     std::string error_name;
     Nan::Persistent<v8::Function> cb;
@@ -3611,6 +3661,9 @@ typedef struct {
  * @param {string} [format=png] image format
  * @param {Object} [options]
  * @param {mapnik.Palette} [options.palette] - mapnik.Palette object
+ * @param {number} [options.threads=1] - encode truecolor PNG (`png32`, `png24`)
+ * and WebP on up to this many threads of a pool shared by all encodes. Other
+ * formats are encoded on one thread.
  * @param {Function} callback - `function(err, encoded)`
  * @returns {Buffer} encoded image data
  * @instance
@@ -3637,6 +3690,7 @@ NAN_METHOD(Image::encode)
 
     std::string format = "png";
     palette_ptr palette;
+    unsigned threads = 1;
 
     // accept custom format
     if (info.Length() >= 1){
@@ -3672,6 +3726,16 @@ NAN_METHOD(Image::encode)
 
             palette = Nan::ObjectWrap::Unwrap<Palette>(obj)->palette();
         }
+
+        if (options->Has(Nan::New("threads").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> threads_val = options->Get(Nan::New("threads").ToLocalChecked());
+            if (!threads_val->IsNumber() || threads_val->IntegerValue() < 0) {
+                Nan::ThrowTypeError("'threads' must be a non-negative integer");
+                return;
+            }
+            threads = threads_val->IntegerValue();
+        }
     }
 
     // ensure callback is a function
@@ -3686,9 +3750,10 @@ NAN_METHOD(Image::encode)
     closure->im = im;
     closure->format = format;
     closure->palette = palette;
+    closure->threads = threads;
     closure->error = false;
     closure->cb.Reset(callback.As<v8::Function>());
-    uv_queue_work(uv_default_loop(), &closure->request, EIO_Encode, (uv_after_work_cb)EIO_AfterEncode);
+    node_mapnik::queue_work(&closure->request, EIO_Encode, (uv_after_work_cb)EIO_AfterEncode, node_mapnik::WORK_CLASS_ENCODE);
     im->Ref();
 
     return;
@@ -3699,14 +3764,20 @@ void Image::EIO_Encode(uv_work_t* req)
     encode_image_baton_t *closure = static_cast<encode_image_baton_t *>(req->data);
 
     try {
+        std::string key;
+        if (node_mapnik::encode_cache_lookup(*(closure->im->this_), closure->format, closure->palette.get(), key, closure->result))
+        {
+            return;
+        }
         if (closure->palette.get())
         {
             closure->result = save_to_string(*(closure->im->this_), closure->format, *closure->palette);
         }
-        else
+        else if (!node_mapnik::encode_parallel(*(closure->im->this_), closure->format, closure->threads, closure->result))
         {
             closure->result = save_to_string(*(closure->im->this_), closure->format);
         }
+        node_mapnik::encode_cache_insert(key, closure->result);
     }
     catch (std::exception const& ex)
     {
@@ -4214,19 +4285,52 @@ NAN_SETTER(Image::set_offset)
 }
 
 /**
- * Return a copy of the pixel data in this image as a buffer
+ * Return the pixel data in this image as a buffer. By default this is a copy.
+ * With `copy: false` the buffer shares memory with the image instead: no
+ * pixels are copied, writes to the buffer change the image and later changes
+ * to the image (`setPixel`, `fill`, `premultiply`, rendering, ...) are visible
+ * through the buffer. Repeated calls with `copy: false` return the same buffer.
+ * This is the reverse of {@link mapnik.Image.fromBufferSync}.
  *
  * @name data
  * @instance
  * @memberof Image
+ * @param {Object} [options]
+ * @param {boolean} [options.copy=true] - return a copy of the pixel data
+ * rather than a buffer sharing memory with the image
  * @returns {Buffer} pixel data as a buffer
  * @example
  * var img = new mapnik.Image.open('./path/to/image.png');
  * var buffr = img.data();
+ * var view = img.data({copy: false}); // no copy, shares memory with img
  */
 NAN_METHOD(Image::data)
 {
     Image* im = Nan::ObjectWrap::Unwrap<Image>(info.Holder());
-    // TODO - make this zero copy
+    bool copy = true;
+    if (info.Length() >= 1)
+    {
+        if (!info[0]->IsObject())
+        {
+            Nan::ThrowTypeError("optional first arg must be an options object");
+            return;
+        }
+        v8::Local<v8::Object> options = info[0]->ToObject();
+        if (options->Has(Nan::New("copy").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> copy_opt = options->Get(Nan::New("copy").ToLocalChecked());
+            if (!copy_opt->IsBoolean())
+            {
+                Nan::ThrowTypeError("'copy' must be a boolean");
+                return;
+            }
+            copy = copy_opt->BooleanValue();
+        }
+    }
+    if (!copy && im->this_->size() > 0)
+    {
+        info.GetReturnValue().Set(im->data_view());
+        return;
+    }
     info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char *>(im->this_->bytes()), im->this_->size()).ToLocalChecked());
 }
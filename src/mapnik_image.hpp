@@ -120,10 +120,12 @@ public:
     Image(unsigned int width, unsigned int height, mapnik::image_dtype type, bool initialized, bool premultiplied, bool painted);
     Image(image_ptr this_);
     inline image_ptr get() { return this_; }
+    v8::Local<v8::Object> data_view();
 
 private:
     ~Image();
     image_ptr this_;
+    Nan::Persistent<v8::Object> data_view_;
 };
 
 #endif
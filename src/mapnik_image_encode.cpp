@@ -0,0 +1,425 @@
+#include "mapnik_image_encode.hpp"
+#include "mapnik_thread_pool.hpp"
+#include "utils.hpp"
+
+#include <mapnik/image.hpp>
+#include <mapnik/image_util.hpp>        // for demultiply_alpha
+
+#if defined(HAVE_WEBP)
+#include <mapnik/webp_io.hpp>
+#endif
+
+#include "zlib.h"
+
+// stl
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+namespace {
+
+// Rows are filtered and deflated in strips of roughly this many bytes.
+static const std::size_t png_strip_bytes = 256 * 1024;
+// Every strip but the first is primed with the end of the data before it,
+// so the strips compress about as well as one stream would.
+static const std::size_t png_dictionary_bytes = 32768;
+
+typedef std::vector<std::pair<std::string, std::string> > format_options;
+
+// Splits "name:key=value:key=value" into the name and its options.
+std::string split_format(std::string const& format, format_options & options)
+{
+    std::size_t pos = format.find(':');
+    std::string name = format.substr(0, pos);
+    while (pos != std::string::npos)
+    {
+        std::size_t start = pos + 1;
+        pos = format.find(':', start);
+        std::string token = format.substr(start, pos == std::string::npos ? std::string::npos : pos - start);
+        std::size_t eq = token.find('=');
+        if (eq == std::string::npos)
+        {
+            options.emplace_back(token, std::string());
+        }
+        else
+        {
+            options.emplace_back(token.substr(0, eq), token.substr(eq + 1));
+        }
+    }
+    return name;
+}
+
+bool parse_int(std::string const& str, int & value)
+{
+    if (str.empty()) return false;
+    char * end = nullptr;
+    long result = std::strtol(str.c_str(), &end, 10);
+    if (*end != '\0') return false;
+    value = static_cast<int>(result);
+    return true;
+}
+
+void write_uint32(std::string & out, std::uint32_t value)
+{
+    out.push_back(static_cast<char>((value >> 24) & 0xff));
+    out.push_back(static_cast<char>((value >> 16) & 0xff));
+    out.push_back(static_cast<char>((value >> 8) & 0xff));
+    out.push_back(static_cast<char>(value & 0xff));
+}
+
+void write_chunk(std::string & out, char const* type, std::string const& data)
+{
+    write_uint32(out, static_cast<std::uint32_t>(data.size()));
+    std::size_t start = out.size();
+    out.append(type, 4);
+    out.append(data);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<Bytef const*>(out.data() + start), static_cast<uInt>(data.size() + 4));
+    write_uint32(out, static_cast<std::uint32_t>(crc));
+}
+
+inline int paeth_predictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Appends `row` to `out` with whichever of the five PNG filters gives the
+// smallest sum of absolute values, the same heuristic libpng uses.
+void filter_row(unsigned char const* row,
+                unsigned char const* prev,
+                std::size_t length,
+                std::size_t bpp,
+                std::vector<unsigned char> & scratch,
+                std::string & out)
+{
+    unsigned char * filtered[5];
+    for (std::size_t f = 0; f < 5; ++f)
+    {
+        filtered[f] = &scratch[f * length];
+    }
+    unsigned long sums[5] = { 0, 0, 0, 0, 0 };
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        int x = row[i];
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int b = prev[i];
+        int c = i >= bpp ? prev[i - bpp] : 0;
+        unsigned char values[5] = {
+            static_cast<unsigned char>(x),
+            static_cast<unsigned char>(x - a),
+            static_cast<unsigned char>(x - b),
+            static_cast<unsigned char>(x - ((a + b) >> 1)),
+            static_cast<unsigned char>(x - paeth_predictor(a, b, c))
+        };
+        for (std::size_t f = 0; f < 5; ++f)
+        {
+            filtered[f][i] = values[f];
+            sums[f] += static_cast<unsigned long>(std::abs(static_cast<int>(static_cast<signed char>(values[f]))));
+        }
+    }
+    std::size_t best = 0;
+    for (std::size_t f = 1; f < 5; ++f)
+    {
+        if (sums[f] < sums[best]) best = f;
+    }
+    out.push_back(static_cast<char>(best));
+    out.append(reinterpret_cast<char const*>(filtered[best]), length);
+}
+
+// Appends the filtered scanlines of rows [first_row, last_row) to `out`.
+void filter_rows(mapnik::image_rgba8 const& image,
+                 bool alpha,
+                 std::size_t first_row,
+                 std::size_t last_row,
+                 std::string & out)
+{
+    std::size_t width = image.width();
+    std::size_t bpp = alpha ? 4 : 3;
+    std::size_t length = width * bpp;
+    std::vector<unsigned char> scratch(5 * length);
+    std::vector<unsigned char> zero(length, 0);
+    std::vector<unsigned char> current;
+    std::vector<unsigned char> previous;
+    // Packs a row into RGB when the alpha channel is dropped.
+    auto packed = [&](std::size_t y, std::vector<unsigned char> & buffer) -> unsigned char const* {
+        unsigned char const* rgba = reinterpret_cast<unsigned char const*>(image.get_row(y));
+        if (alpha) return rgba;
+        buffer.resize(length);
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            buffer[x * 3] = rgba[x * 4];
+            buffer[x * 3 + 1] = rgba[x * 4 + 1];
+            buffer[x * 3 + 2] = rgba[x * 4 + 2];
+        }
+        return buffer.data();
+    };
+    unsigned char const* prev = first_row > 0 ? packed(first_row - 1, previous) : zero.data();
+    for (std::size_t y = first_row; y < last_row; ++y)
+    {
+        unsigned char const* row = packed(y, current);
+        filter_row(row, prev, length, bpp, scratch, out);
+        if (!alpha)
+        {
+            std::swap(current, previous);
+            row = previous.data();
+        }
+        prev = row;
+    }
+}
+
+struct png_strip
+{
+    png_strip()
+        : data(),
+          adler(0),
+          raw_size(0) {}
+    std::string data;
+    uLong adler;
+    std::size_t raw_size;
+};
+
+void deflate_strip(mapnik::image_rgba8 const& image,
+                   bool alpha,
+                   int level,
+                   std::size_t first_row,
+                   std::size_t last_row,
+                   bool last,
+                   png_strip & strip)
+{
+    std::size_t scanline = image.width() * (alpha ? 4 : 3) + 1;
+    std::string raw;
+    raw.reserve(scanline * (last_row - first_row));
+    filter_rows(image, alpha, first_row, last_row, raw);
+
+    // Filtering is deterministic, so the end of the previous strip can be
+    // rebuilt here instead of waiting for the task that owns it.
+    std::string dictionary;
+    if (first_row > 0)
+    {
+        std::size_t rows = (png_dictionary_bytes + scanline - 1) / scanline;
+        filter_rows(image, alpha, first_row - std::min(rows, first_row), first_row, dictionary);
+        if (dictionary.size() > png_dictionary_bytes)
+        {
+            dictionary.erase(0, dictionary.size() - png_dictionary_bytes);
+        }
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    if (!dictionary.empty())
+    {
+        deflateSetDictionary(&stream,
+                             reinterpret_cast<Bytef const*>(dictionary.data()),
+                             static_cast<uInt>(dictionary.size()));
+    }
+    std::size_t offset = strip.data.size();
+    // A sync flush ends the strip on a byte boundary without ending the
+    // stream; it adds at most a few bytes over the bound.
+    strip.data.resize(offset + deflateBound(&stream, raw.size()) + 64);
+    stream.next_in = reinterpret_cast<Bytef *>(&raw[0]);
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&strip.data[offset]);
+    stream.avail_out = static_cast<uInt>(strip.data.size() - offset);
+    int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    std::size_t written = stream.total_out;
+    deflateEnd(&stream);
+    if (ret != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0)
+    {
+        throw std::runtime_error("Failed to compress image");
+    }
+    strip.data.resize(offset + written);
+    strip.adler = adler32(adler32(0L, Z_NULL, 0),
+                          reinterpret_cast<Bytef const*>(raw.data()),
+                          static_cast<uInt>(raw.size()));
+    strip.raw_size = raw.size();
+}
+
+// `png32` and `png24` with at most a compression level; any other option
+// is left to mapnik.
+bool parse_png_options(format_options const& options, int & level, bool & alpha)
+{
+    for (auto const& option : options)
+    {
+        int value = 0;
+        if (option.first == "z" && parse_int(option.second, level) &&
+            level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION)
+        {
+            continue;
+        }
+        // Like mapnik, truecolor PNG drops the alpha channel only for `t=0`.
+        if (option.first == "t" && parse_int(option.second, value) &&
+            value >= 0 && value <= 2)
+        {
+            alpha = value != 0;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+void encode_png(mapnik::image_rgba8 const& image,
+                bool alpha,
+                int level,
+                std::size_t threads,
+                std::string & out)
+{
+    std::size_t height = image.height();
+    std::size_t scanline = image.width() * (alpha ? 4 : 3) + 1;
+    std::size_t strip_rows = std::max<std::size_t>(1, png_strip_bytes / scanline);
+    std::size_t count = (height + strip_rows - 1) / strip_rows;
+    std::vector<png_strip> strips(count);
+
+    // The zlib header goes in front of the first strip.
+    int flevel = 2;
+    if (level == Z_NO_COMPRESSION || level == 1) flevel = 0;
+    else if (level >= 2 && level <= 5) flevel = 1;
+    else if (level >= 7) flevel = 3;
+    unsigned cmf = 0x78;
+    unsigned flg = static_cast<unsigned>(flevel) << 6;
+    flg += 31 - ((cmf << 8) + flg) % 31;
+    strips[0].data.push_back(static_cast<char>(cmf));
+    strips[0].data.push_back(static_cast<char>(flg));
+
+    parallel_for(count, threads, [&](std::size_t i) {
+        std::size_t first_row = i * strip_rows;
+        std::size_t last_row = std::min(height, first_row + strip_rows);
+        deflate_strip(image, alpha, level, first_row, last_row, i + 1 == count, strips[i]);
+    });
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (auto const& strip : strips)
+    {
+        adler = adler32_combine(adler, strip.adler, static_cast<z_off_t>(strip.raw_size));
+    }
+    write_uint32(strips.back().data, static_cast<std::uint32_t>(adler));
+
+    std::string header;
+    write_uint32(header, static_cast<std::uint32_t>(image.width()));
+    write_uint32(header, static_cast<std::uint32_t>(height));
+    header.push_back(8);                 // bit depth
+    header.push_back(alpha ? 6 : 2);     // truecolor with or without alpha
+    header.push_back(0);                 // deflate
+    header.push_back(0);                 // adaptive filtering
+    header.push_back(0);                 // no interlace
+
+    std::size_t size = 8 + 25 + 12;
+    for (auto const& strip : strips)
+    {
+        size += strip.data.size() + 12;
+    }
+    out.reserve(out.size() + size);
+    out.append("\x89PNG\r\n\x1a\n", 8);
+    write_chunk(out, "IHDR", header);
+    for (auto const& strip : strips)
+    {
+        write_chunk(out, "IDAT", strip.data);
+    }
+    write_chunk(out, "IEND", std::string());
+}
+
+#if defined(HAVE_WEBP)
+// `webp` with `quality`, `method` and `lossless`; any other option is left
+// to mapnik.
+bool parse_webp_options(format_options const& options, WebPConfig & config)
+{
+    for (auto const& option : options)
+    {
+        int value = 0;
+        if (option.first == "quality" && parse_int(option.second, value))
+        {
+            config.quality = static_cast<float>(value);
+        }
+        else if (option.first == "method" && parse_int(option.second, value))
+        {
+            config.method = value;
+        }
+        else if (option.first == "lossless" && parse_int(option.second, value))
+        {
+            config.lossless = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return WebPValidateConfig(&config) != 0;
+}
+#endif
+
+} // end anonymous ns
+
+bool encode_parallel(mapnik::image_any const& image,
+                     std::string const& format,
+                     std::size_t threads,
+                     std::string & out)
+{
+    if (threads < 2 || !image.is<mapnik::image_rgba8>())
+    {
+        return false;
+    }
+    mapnik::image_rgba8 const& rgba = mapnik::util::get<mapnik::image_rgba8>(image);
+    if (rgba.width() == 0 || rgba.height() == 0)
+    {
+        return false;
+    }
+
+    format_options options;
+    std::string name = split_format(format, options);
+    int level = Z_DEFAULT_COMPRESSION;
+    bool alpha = true;
+    bool png = (name == "png32" || name == "png24") && parse_png_options(options, level, alpha);
+#if defined(HAVE_WEBP)
+    WebPConfig config;
+    bool webp = name == "webp" && WebPConfigInit(&config) && parse_webp_options(options, config);
+#else
+    bool webp = false;
+#endif
+    if (!png && !webp)
+    {
+        return false;
+    }
+
+    std::unique_ptr<mapnik::image_rgba8> demultiplied;
+    if (rgba.get_premultiplied())
+    {
+        demultiplied.reset(new mapnik::image_rgba8(rgba));
+        mapnik::demultiply_alpha(*demultiplied);
+    }
+    mapnik::image_rgba8 const& source = demultiplied ? *demultiplied : rgba;
+
+    if (png)
+    {
+        encode_png(source, alpha, level, threads, out);
+    }
+#if defined(HAVE_WEBP)
+    else
+    {
+        config.thread_level = 1;
+        string_streambuf buffer(out);
+        std::ostream stream(&buffer);
+        mapnik::save_as_webp(stream, source, config, true);
+    }
+#endif
+    return true;
+}
+
+} // end ns
@@ -0,0 +1,30 @@
+#ifndef __NODE_MAPNIK_IMAGE_ENCODE_H__
+#define __NODE_MAPNIK_IMAGE_ENCODE_H__
+
+#include <mapnik/image_any.hpp>
+
+// stl
+#include <cstddef>
+#include <string>
+
+namespace node_mapnik {
+
+// Encodes `image` to `out` with up to `threads` threads of the shared pool.
+//
+// Truecolor PNG (`png32` and `png24`, optionally with `z=<level>` and
+// `t=<mode>`) is written as RGBA, or RGB for `t=0`, as mapnik does. It is
+// filtered and deflated in independent strips of rows which are joined into
+// a single zlib stream. WebP (`webp` with `quality`, `method` or `lossless`)
+// is encoded by libwebp with threading enabled.
+//
+// Returns false, leaving `out` untouched, when `threads` is below 2 or the
+// image, format or its options can only be encoded on one thread; the caller
+// then falls back to `mapnik::save_to_string`.
+bool encode_parallel(mapnik::image_any const& image,
+                     std::string const& format,
+                     std::size_t threads,
+                     std::string & out);
+
+} // end ns
+
+#endif
@@ -9,6 +9,8 @@
 #include "mapnik_image_view.hpp"
 #include "mapnik_color.hpp"
 #include "mapnik_palette.hpp"
+#include "mapnik_encode_cache.hpp"
+#include "mapnik_thread_pool.hpp"
 #include "utils.hpp"
 
 // std
@@ -417,12 +419,17 @@ NAN_METHOD(ImageView::encodeSync)
 
     try {
         std::string s;
-        if (palette.get())
+        std::string key;
+        if (!node_mapnik::encode_cache_lookup(*(im->this_), format, palette.get(), key, s))
         {
-            s = save_to_string(*(im->this_), format, *palette);
-        }
-        else {
-            s = save_to_string(*(im->this_), format);
+            if (palette.get())
+            {
+                s = save_to_string(*(im->this_), format, *palette);
+            }
+            else {
+                s = save_to_string(*(im->this_), format);
+            }
+            node_mapnik::encode_cache_insert(key, s);
         }
 
         info.GetReturnValue().Set(Nan::CopyBuffer((char*)s.data(),s.size()).ToLocalChecked());
@@ -501,7 +508,7 @@ NAN_METHOD(ImageView::encode)
     baton->format = format;
     baton->palette = palette;
     baton->cb.Reset(callback.As<v8::Function>());
-    uv_queue_work(uv_default_loop(), &baton->request, AsyncEncode, (uv_after_work_cb)AfterEncode);
+    node_mapnik::queue_work(&baton->request, AsyncEncode, (uv_after_work_cb)AfterEncode, node_mapnik::WORK_CLASS_ENCODE);
     im->Ref();
     return;
 }
@@ -511,6 +518,11 @@ void ImageView::AsyncEncode(uv_work_t* req)
     encode_image_view_baton_t *baton = static_cast<encode_image_view_baton_t *>(req->data);
 
     try {
+        std::string key;
+        if (node_mapnik::encode_cache_lookup(*(baton->im->this_), baton->format, baton->palette.get(), key, baton->result))
+        {
+            return;
+        }
         if (baton->palette.get())
         {
             baton->result = save_to_string(*(baton->im->this_), baton->format, *baton->palette);
@@ -519,6 +531,7 @@ void ImageView::AsyncEncode(uv_work_t* req)
         {
             baton->result = save_to_string(*(baton->im->this_), baton->format);
         }
+        node_mapnik::encode_cache_insert(key, baton->result);
     }
     catch (std::exception const& ex)
     {
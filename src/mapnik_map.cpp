@@ -1,6 +1,7 @@
 #include "mapnik_map.hpp"
 #include "utils.hpp"
 #include "mapnik_color.hpp"             // for Color, Color::constructor
+#include "mapnik_feature.hpp"           // for Feature
 #include "mapnik_featureset.hpp"        // for Featureset
 #if defined(GRID_RENDERER)
 #include "mapnik_grid.hpp"              // for Grid, Grid::constructor
@@ -10,16 +11,25 @@
 #include "mapnik_palette.hpp"           // for palette_ptr, Palette, etc
 #include "mapnik_vector_tile.hpp"
 #include "object_to_container.hpp"
+#include "agg_renderer_visitor.hpp"
+#include "mapnik_thread_pool.hpp"
+#include "mapnik_stylesheet_cache.hpp"
 
 // mapnik-vector-tile
+#include "vector_tile_composite.hpp"
 #include "vector_tile_processor.hpp"
+#include "vector_tile_projection.hpp"
 
 // mapnik
 #include <mapnik/agg_renderer.hpp>      // for agg_renderer
 #include <mapnik/box2d.hpp>             // for box2d
 #include <mapnik/color.hpp>             // for color
 #include <mapnik/attribute.hpp>        // for attributes
+#include <mapnik/datasource.hpp>        // for datasource
+#include <mapnik/feature_layer_desc.hpp>  // for layer_descriptor
+#include <mapnik/feature_type_style.hpp>  // for feature_type_style
 #include <mapnik/featureset.hpp>        // for featureset_ptr
+#include <mapnik/geometry.hpp>          // for geometry
 #if defined(GRID_RENDERER)
 #include <mapnik/grid/grid.hpp>         // for hit_grid, grid
 #include <mapnik/grid/grid_renderer.hpp>  // for grid_renderer
@@ -30,8 +40,17 @@
 #include <mapnik/layer.hpp>             // for layer
 #include <mapnik/load_map.hpp>          // for load_map, load_map_string
 #include <mapnik/map.hpp>               // for Map, etc
+#include <mapnik/marker.hpp>            // for marker, marker_null
+#include <mapnik/marker_cache.hpp>      // for marker_cache
 #include <mapnik/params.hpp>            // for parameters
+#include <mapnik/parse_path.hpp>        // for path_processor_type
+#include <mapnik/projection.hpp>        // for projection
+#include <mapnik/proj_transform.hpp>    // for proj_transform
+#include <mapnik/query.hpp>             // for query
+#include <mapnik/rule.hpp>              // for rule
+#include <mapnik/symbolizer.hpp>        // for symbolizer, get_optional
 #include <mapnik/save_map.hpp>          // for save_map, etc
+#include <mapnik/well_known_srs.hpp>    // for is_well_known_srs
 #include <mapnik/image_scaling.hpp>
 #include <mapnik/request.hpp>
 #if defined(HAVE_CAIRO)
@@ -39,7 +58,11 @@
 #endif
 
 // stl
+#include <algorithm>
+#include <chrono>
 #include <exception>                    // for exception
+#include <set>
+#include <thread>
 #include <iosfwd>                       // for ostringstream, ostream
 #include <ostream>                      // for operator<<, basic_ostream, etc
 #include <sstream>                      // for basic_ostringstream, etc
@@ -119,6 +142,8 @@ void Map::Initialize(v8::Local<v8::Object> target) {
     Nan::SetPrototypeMethod(lcons, "renderSync", renderSync);
     Nan::SetPrototypeMethod(lcons, "renderFile", renderFile);
     Nan::SetPrototypeMethod(lcons, "renderFileSync", renderFileSync);
+    Nan::SetPrototypeMethod(lcons, "renderMetatile", renderMetatile);
+    Nan::SetPrototypeMethod(lcons, "warmup", warmup);
 
     Nan::SetPrototypeMethod(lcons, "zoomAll", zoomAll);
     Nan::SetPrototypeMethod(lcons, "zoomToBox", zoomToBox); //setExtent
@@ -589,8 +614,13 @@ typedef struct {
     uv_work_t request;
     Map *m;
     std::map<std::string,mapnik::featureset_ptr> featuresets;
+    std::map<std::string,std::vector<mapnik::feature_ptr> > features;
     int layer_idx;
     bool geo_coords;
+    bool read_features;
+    bool geometry;
+    std::size_t limit;
+    std::size_t threads;
     double x;
     double y;
     bool error;
@@ -610,9 +640,18 @@ typedef struct {
  * @param {Object} [options]
  * @param {String|number} [options.layer] - layer name (string) or index (positive integer, 0 index)
  * to query. If left blank, will query all layers.
+ * @param {Boolean} [options.features=false] - read the matching features in the worker thread
+ * and return them as `features` arrays of `Feature` objects instead of `featureset` iterators
+ * which would read from the datasources on the main thread
+ * @param {number} [options.limit=0] - with `features`, the maximum number of features read
+ * from each layer, `0` for no limit
+ * @param {Boolean} [options.geometry=true] - with `features`, set to `false` to drop the
+ * geometries and only keep ids and attributes
+ * @param {number} [options.threads=1] - number of layers queried at the same time when
+ * querying all layers
  * @param {Function} callback
  * @returns {Array} array - An array of `Featureset` objects and layer names, which each contain their own 
- * `Feature` objects.
+ * `Feature` objects. With `options.features` each layer has a `features` array instead of a `featureset`.
  * @example
  * // iterate over the first layer returned and get all attribute information for each feature
  * map.queryMapPoint(10, 10, {layer: 0}, function(err, results) {
@@ -646,9 +685,18 @@ NAN_METHOD(Map::queryMapPoint)
  * @param {Object} [options]
  * @param {String|number} [options.layer] - layer name (string) or index (positive integer, 0 index)
  * to query. If left blank, will query all layers.
+ * @param {Boolean} [options.features=false] - read the matching features in the worker thread
+ * and return them as `features` arrays of `Feature` objects instead of `featureset` iterators
+ * which would read from the datasources on the main thread
+ * @param {number} [options.limit=0] - with `features`, the maximum number of features read
+ * from each layer, `0` for no limit
+ * @param {Boolean} [options.geometry=true] - with `features`, set to `false` to drop the
+ * geometries and only keep ids and attributes
+ * @param {number} [options.threads=1] - number of layers queried at the same time when
+ * querying all layers
  * @param {Function} callback
  * @returns {Array} array - An array of `Featureset` objects and layer names, which each contain their own 
- * `Feature` objects.
+ * `Feature` objects. With `options.features` each layer has a `features` array instead of a `featureset`.
  * @example
  * // query based on web mercator coordinates
  * map.queryMapPoint(-12957605.0331, 5518141.9452, {layer: 0}, function(err, results) {
@@ -695,6 +743,10 @@ v8::Local<v8::Value> Map::abstractQueryPoint(Nan::NAN_METHOD_ARGS_TYPE info, boo
 
     v8::Local<v8::Object> options = Nan::New<v8::Object>();
     int layer_idx = -1;
+    bool read_features = false;
+    bool geometry = true;
+    std::size_t limit = 0;
+    std::size_t threads = 1;
 
     if (info.Length() > 3)
     {
@@ -772,6 +824,50 @@ v8::Local<v8::Value> Map::abstractQueryPoint(Nan::NAN_METHOD_ARGS_TYPE info, boo
                 }
             }
         }
+
+        if (options->Has(Nan::New("features").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("features").ToLocalChecked());
+            if (!param_val->IsBoolean())
+            {
+                Nan::ThrowTypeError("option 'features' must be a boolean");
+                return Nan::Undefined();
+            }
+            read_features = param_val->BooleanValue();
+        }
+
+        if (options->Has(Nan::New("geometry").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("geometry").ToLocalChecked());
+            if (!param_val->IsBoolean())
+            {
+                Nan::ThrowTypeError("option 'geometry' must be a boolean");
+                return Nan::Undefined();
+            }
+            geometry = param_val->BooleanValue();
+        }
+
+        if (options->Has(Nan::New("limit").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("limit").ToLocalChecked());
+            if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+            {
+                Nan::ThrowTypeError("option 'limit' must be a non-negative integer");
+                return Nan::Undefined();
+            }
+            limit = param_val->IntegerValue();
+        }
+
+        if (options->Has(Nan::New("threads").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("threads").ToLocalChecked());
+            if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+            {
+                Nan::ThrowTypeError("option 'threads' must be a non-negative integer");
+                return Nan::Undefined();
+            }
+            threads = param_val->IntegerValue();
+        }
     }
 
     // ensure function callback
@@ -788,6 +884,10 @@ v8::Local<v8::Value> Map::abstractQueryPoint(Nan::NAN_METHOD_ARGS_TYPE info, boo
     closure->y = y;
     closure->layer_idx = static_cast<std::size_t>(layer_idx);
     closure->geo_coords = geo_coords;
+    closure->read_features = read_features;
+    closure->geometry = geometry;
+    closure->limit = limit;
+    closure->threads = threads;
     closure->error = false;
     closure->cb.Reset(callback.As<v8::Function>());
     uv_queue_work(uv_default_loop(), &closure->request, EIO_QueryMap, (uv_after_work_cb)EIO_AfterQueryMap);
@@ -802,45 +902,78 @@ void Map::EIO_QueryMap(uv_work_t* req)
     try
     {
         std::vector<mapnik::layer> const& layers = closure->m->map_->layers();
+        std::vector<unsigned> indexes;
         if (closure->layer_idx >= 0)
         {
+            indexes.push_back(closure->layer_idx);
+        }
+        else
+        {
+            // query all layers
+            for (unsigned idx = 0; idx < layers.size(); ++idx)
+            {
+                indexes.push_back(idx);
+            }
+        }
+
+        // Each layer is queried into its own slot so that layers can be
+        // read concurrently; results are keyed by layer name afterwards in
+        // layer order, as before.
+        std::vector<mapnik::featureset_ptr> featuresets(indexes.size());
+        std::vector<std::vector<mapnik::feature_ptr> > features(indexes.size());
+        node_mapnik::parallel_for(indexes.size(), closure->threads, [&](std::size_t i) {
             mapnik::featureset_ptr fs;
             if (closure->geo_coords)
             {
-                fs = closure->m->map_->query_point(closure->layer_idx,
+                fs = closure->m->map_->query_point(indexes[i],
                                                    closure->x,
                                                    closure->y);
             }
             else
             {
-                fs = closure->m->map_->query_map_point(closure->layer_idx,
+                fs = closure->m->map_->query_map_point(indexes[i],
                                                        closure->x,
                                                        closure->y);
             }
-            mapnik::layer const& lyr = layers[closure->layer_idx];
-            closure->featuresets.insert(std::make_pair(lyr.name(),fs));
-        }
-        else
-        {
-            // query all layers
-            unsigned idx = 0;
-            for (mapnik::layer const& lyr : layers)
+            if (!closure->read_features)
             {
-                mapnik::featureset_ptr fs;
-                if (closure->geo_coords)
+                featuresets[i] = fs;
+                return;
+            }
+            if (!fs)
+            {
+                return;
+            }
+            mapnik::feature_ptr feature;
+            while ((feature = fs->next()))
+            {
+                if (!closure->geometry)
                 {
-                    fs = closure->m->map_->query_point(idx,
-                                                       closure->x,
-                                                       closure->y);
+                    // datasources such as memory and geojson hand out their
+                    // own features, so copy everything but the geometry
+                    // rather than clearing it in place
+                    mapnik::feature_ptr copy = std::make_shared<mapnik::feature_impl>(feature->context(), feature->id());
+                    copy->set_data(feature->get_data());
+                    feature = copy;
                 }
-                else
+                features[i].push_back(feature);
+                if (closure->limit > 0 && features[i].size() >= closure->limit)
                 {
-                    fs = closure->m->map_->query_map_point(idx,
-                                                           closure->x,
-                                                           closure->y);
+                    break;
                 }
-                closure->featuresets.insert(std::make_pair(lyr.name(),fs));
-                ++idx;
+            }
+        });
+
+        for (std::size_t i = 0; i < indexes.size(); ++i)
+        {
+            mapnik::layer const& lyr = layers[indexes[i]];
+            if (closure->read_features)
+            {
+                closure->features.insert(std::make_pair(lyr.name(),std::move(features[i])));
+            }
+            else
+            {
+                closure->featuresets.insert(std::make_pair(lyr.name(),featuresets[i]));
             }
         }
     }
@@ -858,6 +991,35 @@ void Map::EIO_AfterQueryMap(uv_work_t* req)
     if (closure->error) {
         v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    } else if (closure->read_features) {
+        std::size_t num_result = closure->features.size();
+        if (num_result >= 1)
+        {
+            v8::Local<v8::Array> a = Nan::New<v8::Array>(num_result);
+            unsigned idx = 0;
+            for (auto const& layer_features : closure->features)
+            {
+                std::vector<mapnik::feature_ptr> const& feats = layer_features.second;
+                v8::Local<v8::Array> f = Nan::New<v8::Array>(feats.size());
+                for (unsigned i = 0; i < feats.size(); ++i)
+                {
+                    f->Set(i, Feature::NewInstance(feats[i]));
+                }
+                v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+                obj->Set(Nan::New("layer").ToLocalChecked(), Nan::New<v8::String>(layer_features.first).ToLocalChecked());
+                obj->Set(Nan::New("features").ToLocalChecked(), f);
+                a->Set(idx, obj);
+                ++idx;
+            }
+            closure->features.clear();
+            v8::Local<v8::Value> argv[2] = { Nan::Null(), a };
+            Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+        }
+        else
+        {
+            v8::Local<v8::Value> argv[2] = { Nan::Null(), Nan::Undefined() };
+            Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+        }
     } else {
         std::size_t num_result = closure->featuresets.size();
         if (num_result >= 1)
@@ -1137,7 +1299,7 @@ void Map::EIO_Load(uv_work_t* req)
 
     try
     {
-        mapnik::load_map(*closure->m->map_,closure->stylesheet,closure->strict,closure->base_path);
+        node_mapnik::load_map_cached(*closure->m->map_,closure->stylesheet,false,closure->strict,closure->base_path);
     }
     catch (std::exception const& ex)
     {
@@ -1232,7 +1394,7 @@ NAN_METHOD(Map::loadSync)
 
     try
     {
-        mapnik::load_map(*m->map_,stylesheet,strict,base_path);
+        node_mapnik::load_map_cached(*m->map_,stylesheet,false,strict,base_path);
     }
     catch (std::exception const& ex)
     {
@@ -1310,7 +1472,7 @@ NAN_METHOD(Map::fromStringSync)
 
     try
     {
-        mapnik::load_map_string(*m->map_,stylesheet,strict,base_path);
+        node_mapnik::load_map_cached(*m->map_,stylesheet,true,strict,base_path);
     }
     catch (std::exception const& ex)
     {
@@ -1415,7 +1577,7 @@ void Map::EIO_FromString(uv_work_t* req)
 
     try
     {
-        mapnik::load_map_string(*closure->m->map_,closure->stylesheet,closure->strict,closure->base_path);
+        node_mapnik::load_map_cached(*closure->m->map_,closure->stylesheet,true,closure->strict,closure->base_path);
     }
     catch (std::exception const& ex)
     {
@@ -1637,6 +1799,8 @@ struct vector_tile_baton_t {
     mapnik::vector_tile_impl::polygon_fill_type fill_type;
     bool process_all_rings;
     std::launch threading_mode;
+    unsigned threads;
+    std::vector<std::pair<std::string, double>> layer_timings;
     std::string error_name;
     Nan::Persistent<v8::Function> cb;
     vector_tile_baton_t() :
@@ -1654,7 +1818,9 @@ struct vector_tile_baton_t {
         multi_polygon_union(false),
         fill_type(mapnik::vector_tile_impl::positive_fill),
         process_all_rings(false),
-        threading_mode(std::launch::deferred) {}
+        threading_mode(std::launch::deferred),
+        threads(0),
+        layer_timings() {}
 };
 
 /**
@@ -1680,6 +1846,10 @@ struct vector_tile_baton_t {
  * [Clipper documentation](http://www.angusj.com/delphi/clipper/documentation/Docs/Units/ClipperLib/Types/PolyFillType.htm)
  * to learn more about fill types. (used when rendering a vector tile)
  * @param {String} [options.threading_mode] (used when rendering a vector tile)
+ * @param {Number} [options.threads=0] if set, layers are encoded one by one on
+ * at most this many threads taken from a pool shared by all renders, instead of
+ * `threading_mode`. The callback then gets a third argument mapping each
+ * layer name to the milliseconds spent encoding it. (used when rendering a vector tile)
  * @param {Number} [options.simplify_distance] Simplification works to generalize 
  * geometries before encoding into vector tiles.simplification distance The 
  * `simplify_distance` value works in integer space over a 4096 pixel grid and uses
@@ -1846,7 +2016,7 @@ NAN_METHOD(Map::render)
                 return;
             }
             closure->cb.Reset(info[info.Length() - 1].As<v8::Function>());
-            uv_queue_work(uv_default_loop(), &closure->request, EIO_RenderImage, (uv_after_work_cb)EIO_AfterRenderImage);
+            node_mapnik::queue_work(&closure->request, EIO_RenderImage, (uv_after_work_cb)EIO_AfterRenderImage, node_mapnik::WORK_CLASS_RENDER);
 
         }
 #if defined(GRID_RENDERER)
@@ -1963,7 +2133,7 @@ NAN_METHOD(Map::render)
                 return;
             }
             closure->cb.Reset(info[info.Length() - 1].As<v8::Function>());
-            uv_queue_work(uv_default_loop(), &closure->request, EIO_RenderGrid, (uv_after_work_cb)EIO_AfterRenderGrid);
+            node_mapnik::queue_work(&closure->request, EIO_RenderGrid, (uv_after_work_cb)EIO_AfterRenderGrid, node_mapnik::WORK_CLASS_RENDER);
         }
 #endif
         else if (Nan::New(VectorTile::constructor)->HasInstance(obj))
@@ -2083,6 +2253,18 @@ NAN_METHOD(Map::render)
                 }
             }
 
+            if (options->Has(Nan::New("threads").ToLocalChecked()))
+            {
+                v8::Local<v8::Value> param_val = options->Get(Nan::New("threads").ToLocalChecked());
+                if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+                {
+                    delete closure;
+                    Nan::ThrowTypeError("option 'threads' must be a non-negative integer");
+                    return;
+                }
+                closure->threads = param_val->IntegerValue();
+            }
+
             if (options->Has(Nan::New("simplify_distance").ToLocalChecked()))
             {
                 v8::Local<v8::Value> param_val = options->Get(Nan::New("simplify_distance").ToLocalChecked());
@@ -2141,7 +2323,7 @@ NAN_METHOD(Map::render)
                 return;
             }
             closure->cb.Reset(info[info.Length() - 1].As<v8::Function>());
-            uv_queue_work(uv_default_loop(), &closure->request, EIO_RenderVectorTile, (uv_after_work_cb)EIO_AfterRenderVectorTile);
+            node_mapnik::queue_work(&closure->request, EIO_RenderVectorTile, (uv_after_work_cb)EIO_AfterRenderVectorTile, node_mapnik::WORK_CLASS_RENDER);
         }
         else
         {
@@ -2162,23 +2344,101 @@ NAN_METHOD(Map::render)
     }
 }
 
+static void configure_processor(mapnik::vector_tile_impl::processor & ren, vector_tile_baton_t const* closure)
+{
+    ren.set_simplify_distance(closure->simplify_distance);
+    ren.set_multi_polygon_union(closure->multi_polygon_union);
+    ren.set_fill_type(closure->fill_type);
+    ren.set_process_all_rings(closure->process_all_rings);
+    ren.set_scale_factor(closure->scale_factor);
+    ren.set_strictly_simple(closure->strictly_simple);
+    ren.set_image_format(closure->image_format);
+    ren.set_scaling_method(closure->scaling_method);
+    ren.set_area_threshold(closure->area_threshold);
+}
+
+// Encodes each layer of the map into its own tile on node_mapnik::parallel_for,
+// timing every layer, then merges the tiles into the target in layer order.
+static void render_vector_tile_layers(vector_tile_baton_t * closure)
+{
+    mapnik::Map const& map = *closure->m->get();
+    mapnik::vector_tile_impl::merc_tile & target = *closure->d->get_tile();
+
+    std::vector<mapnik::layer const*> layers;
+    for (mapnik::layer const& lyr : map.layers())
+    {
+        // same as the processor: layers already in the tile are not redone
+        if (!target.has_layer(lyr.name()))
+        {
+            layers.push_back(&lyr);
+        }
+    }
+
+    std::vector<mapnik::vector_tile_impl::merc_tile_ptr> layer_tiles(layers.size());
+    std::vector<double> timings(layers.size(), 0.0);
+    node_mapnik::parallel_for(layers.size(), closure->threads, [&](std::size_t i) {
+        auto start = std::chrono::steady_clock::now();
+        mapnik::Map layer_map(map.width(), map.height(), map.srs());
+        if (map.maximum_extent())
+        {
+            layer_map.set_maximum_extent(*map.maximum_extent());
+        }
+        layer_map.set_buffer_size(map.buffer_size());
+        mapnik::parameters params = map.get_extra_parameters();
+        layer_map.set_extra_parameters(params);
+        layer_map.add_layer(*layers[i]);
+
+        layer_tiles[i] = std::make_shared<mapnik::vector_tile_impl::merc_tile>(target.x(),
+                                                                              target.y(),
+                                                                              target.z(),
+                                                                              target.tile_size(),
+                                                                              target.buffer_size());
+        mapnik::vector_tile_impl::processor ren(layer_map);
+        configure_processor(ren, closure);
+        ren.set_threading_mode(std::launch::deferred);
+        ren.update_tile(*layer_tiles[i],
+                        closure->scale_denominator,
+                        closure->offset_x,
+                        closure->offset_y);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        timings[i] = elapsed.count();
+    });
+
+    // the layer tiles share the extent of the target so this only appends
+    mapnik::Map merge_map(target.tile_size(), target.tile_size(), "+init=epsg:3857");
+    merge_map.set_maximum_extent(target.get_buffered_extent());
+    mapnik::vector_tile_impl::processor ren(merge_map);
+    configure_processor(ren, closure);
+    mapnik::vector_tile_impl::composite(target,
+                                        layer_tiles,
+                                        merge_map,
+                                        ren,
+                                        closure->scale_denominator,
+                                        closure->offset_x,
+                                        closure->offset_y,
+                                        false);
+
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+        closure->layer_timings.emplace_back(layers[i]->name(), timings[i]);
+    }
+}
+
 void Map::EIO_RenderVectorTile(uv_work_t* req)
 {
     vector_tile_baton_t *closure = static_cast<vector_tile_baton_t *>(req->data);
     try
     {
+        if (closure->threads > 0)
+        {
+            render_vector_tile_layers(closure);
+            return;
+        }
+
         mapnik::Map const& map = *closure->m->get();
 
         mapnik::vector_tile_impl::processor ren(map);
-        ren.set_simplify_distance(closure->simplify_distance);
-        ren.set_multi_polygon_union(closure->multi_polygon_union);
-        ren.set_fill_type(closure->fill_type);
-        ren.set_process_all_rings(closure->process_all_rings);
-        ren.set_scale_factor(closure->scale_factor);
-        ren.set_strictly_simple(closure->strictly_simple);
-        ren.set_image_format(closure->image_format);
-        ren.set_scaling_method(closure->scaling_method);
-        ren.set_area_threshold(closure->area_threshold);
+        configure_processor(ren, closure);
         ren.set_threading_mode(closure->threading_mode);
 
         ren.update_tile(*closure->d->get_tile(),
@@ -2198,12 +2458,23 @@ void Map::EIO_AfterRenderVectorTile(uv_work_t* req)
     Nan::HandleScope scope;
     vector_tile_baton_t *closure = static_cast<vector_tile_baton_t *>(req->data);
     closure->m->release();
+    closure->d->reset_cache();
 
     if (closure->error)
     {
         v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
     }
+    else if (closure->threads > 0)
+    {
+        v8::Local<v8::Object> timings = Nan::New<v8::Object>();
+        for (auto const& timing : closure->layer_timings)
+        {
+            timings->Set(Nan::New<v8::String>(timing.first).ToLocalChecked(), Nan::New<v8::Number>(timing.second));
+        }
+        v8::Local<v8::Value> argv[3] = { Nan::Null(), closure->d->handle(), timings };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 3, argv);
+    }
     else
     {
         v8::Local<v8::Value> argv[2] = { Nan::Null(), closure->d->handle() };
@@ -2281,45 +2552,6 @@ void Map::EIO_AfterRenderGrid(uv_work_t* req)
 }
 #endif
 
-struct agg_renderer_visitor
-{
-    agg_renderer_visitor(mapnik::Map const& m,
-                         mapnik::request const& req,
-                         mapnik::attributes const& vars,
-                         double scale_factor,
-                         unsigned offset_x,
-                         unsigned offset_y,
-                         double scale_denominator)
-        : m_(m),
-          req_(req),
-          vars_(vars),
-          scale_factor_(scale_factor),
-          offset_x_(offset_x),
-          offset_y_(offset_y),
-          scale_denominator_(scale_denominator) {}
-
-    void operator() (mapnik::image_rgba8 & pixmap)
-    {
-        mapnik::agg_renderer<mapnik::image_rgba8> ren(m_,req_,vars_,pixmap,scale_factor_,offset_x_,offset_y_);
-        ren.apply(scale_denominator_);
-    }
-
-    template <typename T>
-    void operator() (T &)
-    {
-        throw std::runtime_error("This image type is not currently supported for rendering.");
-    }
-
-  private:
-    mapnik::Map const& m_;
-    mapnik::request const& req_;
-    mapnik::attributes const& vars_;
-    double scale_factor_;
-    unsigned offset_x_;
-    unsigned offset_y_;
-    double scale_denominator_;
-};
-
 void Map::EIO_RenderImage(uv_work_t* req)
 {
     image_baton_t *closure = static_cast<image_baton_t *>(req->data);
@@ -2329,7 +2561,7 @@ void Map::EIO_RenderImage(uv_work_t* req)
         mapnik::Map const& map = *closure->m->map_;
         mapnik::request m_req(map.width(),map.height(),map.get_current_extent());
         m_req.set_buffer_size(closure->buffer_size);
-        agg_renderer_visitor visit(map,
+        node_mapnik::agg_renderer_visitor visit(map,
                                    m_req,
                                    closure->variables,
                                    closure->scale_factor,
@@ -2529,7 +2761,7 @@ NAN_METHOD(Map::renderFile)
     closure->palette = palette;
     closure->output = output;
 
-    uv_queue_work(uv_default_loop(), &closure->request, EIO_RenderFile, (uv_after_work_cb)EIO_AfterRenderFile);
+    node_mapnik::queue_work(&closure->request, EIO_RenderFile, (uv_after_work_cb)EIO_AfterRenderFile, node_mapnik::WORK_CLASS_RENDER);
     m->Ref();
 
     return;
@@ -2597,6 +2829,696 @@ void Map::EIO_AfterRenderFile(uv_work_t* req)
 
 }
 
+struct render_metatile_baton_t {
+    uv_work_t request;
+    Map *m;
+    unsigned z;
+    unsigned x;
+    unsigned y;
+    unsigned cols;
+    unsigned rows;
+    unsigned tile_size;
+    int buffer_size;
+    double scale_factor;
+    double scale_denominator;
+    mapnik::attributes variables;
+    std::string format;
+    palette_ptr palette;
+    std::vector<std::string> tiles;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+    render_metatile_baton_t() :
+        z(0),
+        x(0),
+        y(0),
+        cols(1),
+        rows(1),
+        tile_size(256),
+        buffer_size(0),
+        scale_factor(1.0),
+        scale_denominator(0.0),
+        variables(),
+        format("png"),
+        palette(),
+        tiles(),
+        error(false),
+        error_name() {}
+};
+
+/**
+ * Render a metatile of `metatile x metatile` tiles in a single pass and split
+ * it into encoded tiles. The map is rendered once over the extent of the
+ * whole metatile, so labels are placed once across all of its tiles, and the
+ * tiles are cut and encoded natively and in parallel.
+ *
+ * The map's `srs` must be spherical mercator, either `+init=epsg:3857` or
+ * mapnik's own `+proj=merc` definition. The metatile is the one containing
+ * the tile `z/x/y`: its top left tile is
+ * `x - x % metatile, y - y % metatile` and it is clipped to the bounds of
+ * zoom level `z`. The map's own width, height and extent are not used or
+ * changed.
+ *
+ * @name renderMetatile
+ * @instance
+ * @memberof Map
+ * @param {Object} options
+ * @param {number} options.z - zoom level
+ * @param {number} options.x - column of any tile in the metatile
+ * @param {number} options.y - row of any tile in the metatile
+ * @param {number} [options.metatile=1] - number of tiles along each side
+ * @param {number} [options.tile_size=256] - size of each tile in pixels,
+ * `metatile * tile_size` may be at most 16384
+ * @param {string} [options.format='png'] - image format of the tiles
+ * @param {mapnik.Palette} [options.palette] - mapnik.Palette object
+ * @param {number} [options.buffer_size] - buffer around the metatile in pixels,
+ * defaults to the map's `bufferSize`
+ * @param {number} [options.scale=1.0] - scale factor
+ * @param {number} [options.scale_denominator=0.0]
+ * @param {Object} [options.variables] - variables passed to the renderer
+ * @param {Function} callback - `callback(err, tiles)` where `tiles` is an
+ * array of Buffers in row major order starting at the top left tile of the
+ * metatile, so that tile `tx/ty` is at index `(ty - y0) * columns + (tx - x0)`
+ * @example
+ * map.renderMetatile({z: 10, x: 163, y: 395, metatile: 8, format: 'png8:m=h'}, function(err, tiles) {
+ *   if (err) throw err;
+ *   // tiles[0] is 10/160/392, tiles[1] is 10/161/392, ...
+ * });
+ */
+NAN_METHOD(Map::renderMetatile)
+{
+    if (info.Length() != 2 || !info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("requires an options object and a callback, eg. ({z: 0, x: 0, y: 0}, callback)");
+        return;
+    }
+    v8::Local<v8::Value> callback = info[1];
+    if (!callback->IsFunction())
+    {
+        Nan::ThrowTypeError("last argument must be a callback function");
+        return;
+    }
+    v8::Local<v8::Object> options = info[0]->ToObject();
+    Map* m = Nan::ObjectWrap::Unwrap<Map>(info.Holder());
+
+    // tile bounds are computed in spherical mercator, so any other srs would
+    // silently render the wrong area
+    boost::optional<mapnik::well_known_srs_e> srs = mapnik::is_well_known_srs(m->map_->srs());
+    if (!srs || *srs != mapnik::G_MERC)
+    {
+        Nan::ThrowTypeError("renderMetatile: map srs must be spherical mercator (+init=epsg:3857)");
+        return;
+    }
+
+    static char const* required[3] = { "z", "x", "y" };
+    std::int64_t zxy[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        v8::Local<v8::String> param = Nan::New(required[i]).ToLocalChecked();
+        if (!options->Has(param))
+        {
+            std::string msg = std::string("option '") + required[i] + "' is required";
+            Nan::ThrowTypeError(msg.c_str());
+            return;
+        }
+        v8::Local<v8::Value> param_val = options->Get(param);
+        if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+        {
+            std::string msg = std::string("option '") + required[i] + "' must be a non-negative integer";
+            Nan::ThrowTypeError(msg.c_str());
+            return;
+        }
+        zxy[i] = param_val->IntegerValue();
+    }
+    if (zxy[0] > 30)
+    {
+        Nan::ThrowTypeError("option 'z' must be no greater than 30");
+        return;
+    }
+    std::int64_t num_tiles = static_cast<std::int64_t>(1) << zxy[0];
+    if (zxy[1] >= num_tiles || zxy[2] >= num_tiles)
+    {
+        Nan::ThrowTypeError("options 'x' and 'y' must be valid tile coordinates for zoom level 'z'");
+        return;
+    }
+
+    std::int64_t metatile = 1;
+    if (options->Has(Nan::New("metatile").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> param_val = options->Get(Nan::New("metatile").ToLocalChecked());
+        if (!param_val->IsNumber() || param_val->IntegerValue() <= 0 || param_val->IntegerValue() > 64)
+        {
+            Nan::ThrowTypeError("option 'metatile' must be an integer between 1 and 64");
+            return;
+        }
+        metatile = param_val->IntegerValue();
+    }
+
+    render_metatile_baton_t *closure = new render_metatile_baton_t();
+    closure->buffer_size = m->map_->buffer_size();
+
+    if (options->Has(Nan::New("tile_size").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> param_val = options->Get(Nan::New("tile_size").ToLocalChecked());
+        if (!param_val->IsNumber() || param_val->IntegerValue() <= 0 || param_val->IntegerValue() > 4096)
+        {
+            delete closure;
+            Nan::ThrowTypeError("option 'tile_size' must be an integer between 1 and 4096");
+            return;
+        }
+        closure->tile_size = param_val->IntegerValue();
+    }
+    if (metatile * closure->tile_size > 16384)
+    {
+        delete closure;
+        Nan::ThrowTypeError("options 'metatile' and 'tile_size' must not make a metatile wider than 16384 pixels");
+        return;
+    }
+
+    if (options->Has(Nan::New("format").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> format_opt = options->Get(Nan::New("format").ToLocalChecked());
+        if (!format_opt->IsString())
+        {
+            delete closure;
+            Nan::ThrowTypeError("'format' must be a String");
+            return;
+        }
+        closure->format = TOSTR(format_opt);
+    }
+
+    if (options->Has(Nan::New("palette").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> format_opt = options->Get(Nan::New("palette").ToLocalChecked());
+        if (!format_opt->IsObject())
+        {
+            delete closure;
+            Nan::ThrowTypeError("'palette' must be an object");
+            return;
+        }
+        v8::Local<v8::Object> obj = format_opt->ToObject();
+        if (obj->IsNull() || obj->IsUndefined() || !Nan::New(Palette::constructor)->HasInstance(obj))
+        {
+            delete closure;
+            Nan::ThrowTypeError("mapnik.Palette expected as 'palette' option");
+            return;
+        }
+        closure->palette = Nan::ObjectWrap::Unwrap<Palette>(obj)->palette();
+    }
+
+    if (options->Has(Nan::New("buffer_size").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer_size").ToLocalChecked());
+        if (!bind_opt->IsNumber())
+        {
+            delete closure;
+            Nan::ThrowTypeError("optional arg 'buffer_size' must be a number");
+            return;
+        }
+        closure->buffer_size = bind_opt->IntegerValue();
+    }
+
+    if (options->Has(Nan::New("scale").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> bind_opt = options->Get(Nan::New("scale").ToLocalChecked());
+        if (!bind_opt->IsNumber())
+        {
+            delete closure;
+            Nan::ThrowTypeError("optional arg 'scale' must be a number");
+            return;
+        }
+        closure->scale_factor = bind_opt->NumberValue();
+    }
+
+    if (options->Has(Nan::New("scale_denominator").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> bind_opt = options->Get(Nan::New("scale_denominator").ToLocalChecked());
+        if (!bind_opt->IsNumber())
+        {
+            delete closure;
+            Nan::ThrowTypeError("optional arg 'scale_denominator' must be a number");
+            return;
+        }
+        closure->scale_denominator = bind_opt->NumberValue();
+    }
+
+    if (options->Has(Nan::New("variables").ToLocalChecked()))
+    {
+        v8::Local<v8::Value> bind_opt = options->Get(Nan::New("variables").ToLocalChecked());
+        if (!bind_opt->IsObject())
+        {
+            delete closure;
+            Nan::ThrowTypeError("optional arg 'variables' must be an object");
+            return;
+        }
+        object_to_container(closure->variables,bind_opt->ToObject());
+    }
+
+    closure->z = static_cast<unsigned>(zxy[0]);
+    closure->x = static_cast<unsigned>(zxy[1] - zxy[1] % metatile);
+    closure->y = static_cast<unsigned>(zxy[2] - zxy[2] % metatile);
+    closure->cols = static_cast<unsigned>(std::min(metatile, num_tiles - closure->x));
+    closure->rows = static_cast<unsigned>(std::min(metatile, num_tiles - closure->y));
+
+    if (!m->acquire())
+    {
+        delete closure;
+        Nan::ThrowTypeError("render: Map currently in use by another thread. Consider using a map pool.");
+        return;
+    }
+    closure->request.data = closure;
+    closure->m = m;
+    closure->cb.Reset(callback.As<v8::Function>());
+    node_mapnik::queue_work(&closure->request, EIO_RenderMetatile, (uv_after_work_cb)EIO_AfterRenderMetatile, node_mapnik::WORK_CLASS_RENDER);
+    m->Ref();
+    return;
+}
+
+void Map::EIO_RenderMetatile(uv_work_t* req)
+{
+    render_metatile_baton_t *closure = static_cast<render_metatile_baton_t *>(req->data);
+
+    try
+    {
+        unsigned tile_size = closure->tile_size;
+        mapnik::vector_tile_impl::spherical_mercator merc(tile_size);
+        double minx,miny,maxx,maxy;
+        double ignore_minx,ignore_miny,ignore_maxx,ignore_maxy;
+        // top left tile gives the west and north edges, bottom right tile
+        // gives the east and south edges
+        merc.xyz(closure->x, closure->y, closure->z, minx, ignore_miny, ignore_maxx, maxy);
+        merc.xyz(closure->x + closure->cols - 1, closure->y + closure->rows - 1, closure->z,
+                 ignore_minx, miny, maxx, ignore_maxy);
+        mapnik::box2d<double> extent(minx,miny,maxx,maxy);
+
+        unsigned width = closure->cols * tile_size;
+        unsigned height = closure->rows * tile_size;
+        mapnik::image_rgba8 im(width, height);
+        mapnik::Map const& map = *closure->m->map_;
+        mapnik::request m_req(width, height, extent);
+        m_req.set_buffer_size(closure->buffer_size);
+        mapnik::agg_renderer<mapnik::image_rgba8> ren(map,
+                                                      m_req,
+                                                      closure->variables,
+                                                      im,
+                                                      closure->scale_factor);
+        ren.apply(closure->scale_denominator);
+
+        std::size_t count = closure->cols * closure->rows;
+        closure->tiles.resize(count);
+        node_mapnik::parallel_for(count, std::thread::hardware_concurrency(), [&](std::size_t i) {
+            unsigned col = i % closure->cols;
+            unsigned row = i / closure->cols;
+            mapnik::image_view_any view(mapnik::image_view_rgba8(col * tile_size,
+                                                                 row * tile_size,
+                                                                 tile_size,
+                                                                 tile_size,
+                                                                 im));
+            if (closure->palette.get())
+            {
+                closure->tiles[i] = save_to_string(view, closure->format, *closure->palette);
+            }
+            else
+            {
+                closure->tiles[i] = save_to_string(view, closure->format);
+            }
+        });
+    }
+    catch (std::exception const& ex)
+    {
+        closure->error = true;
+        closure->error_name = ex.what();
+        closure->tiles.clear();
+    }
+}
+
+void Map::EIO_AfterRenderMetatile(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    render_metatile_baton_t *closure = static_cast<render_metatile_baton_t *>(req->data);
+    closure->m->release();
+
+    if (closure->error) {
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    } else {
+        v8::Local<v8::Array> tiles = Nan::New<v8::Array>(closure->tiles.size());
+        for (std::size_t i = 0; i < closure->tiles.size(); ++i)
+        {
+            // hand each encoded tile to its Buffer instead of copying it
+            std::string * tile = new std::string(std::move(closure->tiles[i]));
+            tiles->Set(i, Nan::NewBuffer(&(*tile)[0],
+                                         tile->size(),
+                                         node_mapnik::delete_buffer_owner<std::string>,
+                                         tile).ToLocalChecked());
+        }
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), tiles };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+
+    closure->m->Unref();
+    closure->cb.Reset();
+    delete closure;
+}
+
+struct warmup_baton_t {
+    uv_work_t request;
+    Map *m;
+    mapnik::box2d<double> extent;
+    std::vector<double> scale_denominators;
+    bool fonts;
+    std::size_t threads;
+    std::vector<std::pair<std::string, double>> layer_timings;
+    std::size_t markers;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+    warmup_baton_t() :
+        extent(),
+        scale_denominators(),
+        fonts(true),
+        threads(1),
+        layer_timings(),
+        markers(0),
+        error(false),
+        error_name() {}
+};
+
+// Collects the marker and pattern files a symbolizer refers to, unless
+// their path depends on feature attributes.
+struct warmup_marker_visitor
+{
+    explicit warmup_marker_visitor(std::set<std::string> & paths)
+        : paths_(paths) {}
+
+    template <typename Symbolizer>
+    void operator() (Symbolizer const& sym) const
+    {
+        auto file = mapnik::get_optional<mapnik::path_expression_ptr>(sym, mapnik::keys::file);
+        if (!file || !*file)
+        {
+            return;
+        }
+        std::set<std::string> names;
+        mapnik::path_processor_type::collect_attributes(**file, names);
+        if (!names.empty())
+        {
+            return;
+        }
+        paths_.insert(mapnik::path_processor_type::to_string(**file));
+    }
+
+    std::set<std::string> & paths_;
+};
+
+/**
+ * Prepare the map for its first render. Every layer visible at the given
+ * zoom levels has its datasource queried over `extent`, which opens files,
+ * indexes and connections and reads the first feature, and the markers and
+ * patterns its styles use are loaded into the marker cache. The fonts of
+ * the map are loaded into memory as with `loadFonts`. All of this runs on
+ * the threadpool.
+ *
+ * @name warmup
+ * @instance
+ * @memberof Map
+ * @param {Object} [options]
+ * @param {Array<number>} [options.extent] - extent to query in the map's srs,
+ * defaults to the map's current extent, or the extent of each datasource if
+ * the map has not been zoomed yet
+ * @param {Array<number>} [options.zooms] - zoom levels of a 256 pixel
+ * spherical mercator tile scheme; only layers and rules visible at one of
+ * them are warmed up. Defaults to all layers and rules.
+ * @param {Boolean} [options.fonts=true] - also load the map's fonts
+ * @param {number} [options.threads=1] - number of layers warmed up at the
+ * same time
+ * @param {Function} callback - `callback(err, stats)` where `stats.layers`
+ * maps each warmed up layer to the milliseconds it took and `stats.markers`
+ * is the number of distinct marker and pattern files that were loaded
+ * successfully
+ * @example
+ * map.warmup({zooms: [10, 11, 12]}, function(err, stats) {
+ *   if (err) throw err;
+ *   console.log(stats.layers); // => { world: 12.3 }
+ * });
+ */
+NAN_METHOD(Map::warmup)
+{
+    if (info.Length() < 1 || info.Length() > 2)
+    {
+        Nan::ThrowTypeError("accepts an optional options object and a callback");
+        return;
+    }
+    v8::Local<v8::Value> callback = info[info.Length() - 1];
+    if (!callback->IsFunction())
+    {
+        Nan::ThrowTypeError("last argument must be a callback function");
+        return;
+    }
+    Map* m = Nan::ObjectWrap::Unwrap<Map>(info.Holder());
+
+    warmup_baton_t *closure = new warmup_baton_t();
+    closure->extent = m->map_->get_current_extent();
+
+    if (info.Length() == 2)
+    {
+        if (!info[0]->IsObject())
+        {
+            delete closure;
+            Nan::ThrowTypeError("optional first argument must be an options object");
+            return;
+        }
+        v8::Local<v8::Object> options = info[0]->ToObject();
+
+        if (options->Has(Nan::New("extent").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> extent_opt = options->Get(Nan::New("extent").ToLocalChecked());
+            if (!extent_opt->IsArray() || extent_opt.As<v8::Array>()->Length() != 4)
+            {
+                delete closure;
+                Nan::ThrowTypeError("option 'extent' must be an array of [minx,miny,maxx,maxy]");
+                return;
+            }
+            v8::Local<v8::Array> bbox = extent_opt.As<v8::Array>();
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                if (!bbox->Get(i)->IsNumber())
+                {
+                    delete closure;
+                    Nan::ThrowTypeError("option 'extent' must be an array of [minx,miny,maxx,maxy]");
+                    return;
+                }
+            }
+            closure->extent = mapnik::box2d<double>(bbox->Get(0)->NumberValue(),
+                                                    bbox->Get(1)->NumberValue(),
+                                                    bbox->Get(2)->NumberValue(),
+                                                    bbox->Get(3)->NumberValue());
+        }
+
+        if (options->Has(Nan::New("zooms").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> zooms_opt = options->Get(Nan::New("zooms").ToLocalChecked());
+            if (!zooms_opt->IsArray())
+            {
+                delete closure;
+                Nan::ThrowTypeError("option 'zooms' must be an array of zoom levels");
+                return;
+            }
+            v8::Local<v8::Array> zooms = zooms_opt.As<v8::Array>();
+            for (unsigned i = 0; i < zooms->Length(); ++i)
+            {
+                v8::Local<v8::Value> zoom = zooms->Get(i);
+                if (!zoom->IsNumber() || zoom->IntegerValue() < 0 || zoom->IntegerValue() > 30)
+                {
+                    delete closure;
+                    Nan::ThrowTypeError("option 'zooms' must only contain integers between 0 and 30");
+                    return;
+                }
+                // scale denominator of a 256 pixel tile at this zoom level
+                closure->scale_denominators.push_back(559082264.028717 / (1 << zoom->IntegerValue()));
+            }
+        }
+
+        if (options->Has(Nan::New("fonts").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("fonts").ToLocalChecked());
+            if (!param_val->IsBoolean())
+            {
+                delete closure;
+                Nan::ThrowTypeError("option 'fonts' must be a boolean");
+                return;
+            }
+            closure->fonts = param_val->BooleanValue();
+        }
+
+        if (options->Has(Nan::New("threads").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("threads").ToLocalChecked());
+            if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+            {
+                delete closure;
+                Nan::ThrowTypeError("option 'threads' must be a non-negative integer");
+                return;
+            }
+            closure->threads = param_val->IntegerValue();
+        }
+    }
+
+    if (!m->acquire())
+    {
+        delete closure;
+        Nan::ThrowTypeError("warmup: Map currently in use by another thread. Consider using a map pool.");
+        return;
+    }
+    closure->request.data = closure;
+    closure->m = m;
+    closure->cb.Reset(callback.As<v8::Function>());
+    node_mapnik::queue_work(&closure->request, EIO_Warmup, (uv_after_work_cb)EIO_AfterWarmup, node_mapnik::WORK_CLASS_RENDER);
+    m->Ref();
+    return;
+}
+
+void Map::EIO_Warmup(uv_work_t* req)
+{
+    warmup_baton_t *closure = static_cast<warmup_baton_t *>(req->data);
+
+    try
+    {
+        if (closure->fonts)
+        {
+            closure->m->map_->load_fonts();
+        }
+
+        mapnik::Map const& map = *closure->m->map_;
+        std::vector<double> const& scales = closure->scale_denominators;
+        std::vector<mapnik::layer> const& layers = map.layers();
+        std::vector<double> timings(layers.size(), -1.0);
+        std::vector<std::set<std::string>> markers(layers.size());
+        mapnik::projection map_proj(map.srs());
+
+        node_mapnik::parallel_for(layers.size(), closure->threads, [&](std::size_t i) {
+            mapnik::layer const& lyr = layers[i];
+            bool visible = scales.empty();
+            for (double scale : scales)
+            {
+                visible = visible || lyr.visible(scale);
+            }
+            if (!visible)
+            {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+
+            mapnik::datasource_ptr ds = lyr.datasource();
+            if (ds)
+            {
+                mapnik::box2d<double> query_extent = ds->envelope();
+                if (closure->extent.valid())
+                {
+                    mapnik::projection layer_proj(lyr.srs());
+                    mapnik::proj_transform prj_trans(map_proj, layer_proj);
+                    mapnik::box2d<double> extent = closure->extent;
+                    if (prj_trans.forward(extent))
+                    {
+                        query_extent = extent;
+                    }
+                }
+                mapnik::query q(query_extent);
+                for (auto const& attr_info : ds->get_descriptor().get_descriptors())
+                {
+                    q.add_property_name(attr_info.get_name());
+                }
+                mapnik::featureset_ptr fs = ds->features(q);
+                if (fs)
+                {
+                    fs->next();
+                }
+            }
+
+            std::set<std::string> paths;
+            warmup_marker_visitor visitor(paths);
+            for (std::string const& style_name : lyr.styles())
+            {
+                boost::optional<mapnik::feature_type_style const&> style = map.find_style(style_name);
+                if (!style)
+                {
+                    continue;
+                }
+                for (mapnik::rule const& r : style->get_rules())
+                {
+                    bool active = scales.empty();
+                    for (double scale : scales)
+                    {
+                        active = active || r.active(scale);
+                    }
+                    if (!active)
+                    {
+                        continue;
+                    }
+                    for (mapnik::symbolizer const& sym : r.get_symbolizers())
+                    {
+                        mapnik::util::apply_visitor(visitor, sym);
+                    }
+                }
+            }
+            for (std::string const& path : paths)
+            {
+                std::shared_ptr<mapnik::marker const> marker = mapnik::marker_cache::instance().find(path, true);
+                if (marker && !marker->is<mapnik::marker_null>())
+                {
+                    markers[i].insert(path);
+                }
+            }
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            timings[i] = elapsed.count();
+        });
+
+        std::set<std::string> loaded;
+        for (std::size_t i = 0; i < layers.size(); ++i)
+        {
+            if (timings[i] >= 0)
+            {
+                closure->layer_timings.emplace_back(layers[i].name(), timings[i]);
+            }
+            loaded.insert(markers[i].begin(), markers[i].end());
+        }
+        closure->markers = loaded.size();
+    }
+    catch (std::exception const& ex)
+    {
+        closure->error = true;
+        closure->error_name = ex.what();
+    }
+}
+
+void Map::EIO_AfterWarmup(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    warmup_baton_t *closure = static_cast<warmup_baton_t *>(req->data);
+    closure->m->release();
+
+    if (closure->error) {
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    } else {
+        v8::Local<v8::Object> timings = Nan::New<v8::Object>();
+        for (auto const& timing : closure->layer_timings)
+        {
+            timings->Set(Nan::New<v8::String>(timing.first).ToLocalChecked(), Nan::New<v8::Number>(timing.second));
+        }
+        v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+        stats->Set(Nan::New("layers").ToLocalChecked(), timings);
+        stats->Set(Nan::New("markers").ToLocalChecked(), Nan::New<v8::Number>(closure->markers));
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), stats };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+
+    closure->m->Unref();
+    closure->cb.Reset();
+    delete closure;
+}
+
 // TODO - add support for grids
 NAN_METHOD(Map::renderSync)
 {
@@ -56,6 +56,14 @@ public:
     static void EIO_RenderFile(uv_work_t* req);
     static void EIO_AfterRenderFile(uv_work_t* req);
 
+    static NAN_METHOD(renderMetatile);
+    static void EIO_RenderMetatile(uv_work_t* req);
+    static void EIO_AfterRenderMetatile(uv_work_t* req);
+
+    static NAN_METHOD(warmup);
+    static void EIO_Warmup(uv_work_t* req);
+    static void EIO_AfterWarmup(uv_work_t* req);
+
     // sync rendering
     static NAN_METHOD(renderSync);
     static NAN_METHOD(renderFileSync);
@@ -0,0 +1,432 @@
+#include "mapnik_map_pool.hpp"
+#include "utils.hpp"
+#include "mapnik_map.hpp"               // for Map, Map::constructor
+#include "mapnik_image.hpp"             // for Image, Image::constructor
+#include "object_to_container.hpp"
+#include "agg_renderer_visitor.hpp"
+#include "mapnik_thread_pool.hpp"
+
+// mapnik
+#include <mapnik/attribute.hpp>         // for attributes
+#include <mapnik/box2d.hpp>             // for box2d
+#include <mapnik/image_any.hpp>
+#include <mapnik/map.hpp>               // for Map, etc
+#include <mapnik/request.hpp>
+
+// stl
+#include <cstdlib>                      // for getenv, atoi
+#include <exception>                    // for exception
+
+Nan::Persistent<v8::FunctionTemplate> MapPool::constructor;
+
+struct map_pool_baton_t {
+    uv_work_t request;
+    MapPool *p;
+    map_ptr map;
+    Image *im;
+    int buffer_size;
+    double scale_factor;
+    double scale_denominator;
+    mapnik::attributes variables;
+    unsigned offset_x;
+    unsigned offset_y;
+    bool use_extent;
+    mapnik::box2d<double> extent;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+    map_pool_baton_t() :
+      p(nullptr),
+      map(),
+      im(nullptr),
+      buffer_size(0),
+      scale_factor(1.0),
+      scale_denominator(0.0),
+      variables(),
+      offset_x(0),
+      offset_y(0),
+      use_extent(false),
+      extent(),
+      error(false),
+      error_name() {}
+};
+
+/**
+ * **`mapnik.MapPool`**
+ *
+ * A fixed set of copies of a loaded `mapnik.Map` that can render concurrently.
+ * Each call to `render` is handed the next free copy; when all copies are busy
+ * the request is queued (first in, first out) instead of failing with
+ * "Map currently in use". The pool is a snapshot: changes made to the source
+ * map after the pool is created are not reflected in the copies.
+ *
+ * @class MapPool
+ * @param {mapnik.Map} map - a loaded map to copy
+ * @param {Object} [options]
+ * @param {number} [options.size] - number of copies to keep, defaults to
+ * `UV_THREADPOOL_SIZE` or 4
+ * @property {number} size - number of copies in the pool
+ * @property {number} available - number of copies not currently rendering
+ * @property {number} pending - number of renders waiting for a free copy
+ * @example
+ * var map = new mapnik.Map(256, 256);
+ * map.loadSync('./style.xml');
+ * var pool = new mapnik.MapPool(map, {size: 8});
+ * var im = new mapnik.Image(256, 256);
+ * pool.render(im, {extent: [-20037508.34,-20037508.34,20037508.34,20037508.34]}, function(err, im) {
+ *   if (err) throw err;
+ * });
+ */
+void MapPool::Initialize(v8::Local<v8::Object> target) {
+
+    Nan::HandleScope scope;
+
+    v8::Local<v8::FunctionTemplate> lcons = Nan::New<v8::FunctionTemplate>(MapPool::New);
+    lcons->InstanceTemplate()->SetInternalFieldCount(1);
+    lcons->SetClassName(Nan::New("MapPool").ToLocalChecked());
+
+    Nan::SetPrototypeMethod(lcons, "render", render);
+
+    // properties
+    ATTR(lcons, "size", get_prop, 0);
+    ATTR(lcons, "available", get_prop, 0);
+    ATTR(lcons, "pending", get_prop, 0);
+
+    target->Set(Nan::New("MapPool").ToLocalChecked(),lcons->GetFunction());
+    constructor.Reset(lcons);
+}
+
+MapPool::MapPool(mapnik::Map const& map, unsigned size) :
+    Nan::ObjectWrap(),
+    maps_(),
+    available_(),
+    pending_()
+{
+    maps_.reserve(size);
+    for (unsigned i = 0; i < size; ++i)
+    {
+        maps_.push_back(std::make_shared<mapnik::Map>(map));
+    }
+    available_ = maps_;
+}
+
+MapPool::~MapPool() { }
+
+NAN_METHOD(MapPool::New)
+{
+    if (!info.IsConstructCall())
+    {
+        Nan::ThrowError("Cannot call constructor as function, you need to use 'new' keyword");
+        return;
+    }
+
+    if (info.Length() < 1 || !info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("first argument must be a mapnik.Map");
+        return;
+    }
+
+    v8::Local<v8::Object> obj = info[0]->ToObject();
+    if (obj->IsNull() || obj->IsUndefined() || !Nan::New(Map::constructor)->HasInstance(obj))
+    {
+        Nan::ThrowTypeError("first argument must be a mapnik.Map");
+        return;
+    }
+    Map* m = Nan::ObjectWrap::Unwrap<Map>(obj);
+
+    int size = 4;
+    char const* threadpool_size = std::getenv("UV_THREADPOOL_SIZE");
+    if (threadpool_size && std::atoi(threadpool_size) > 0)
+    {
+        size = std::atoi(threadpool_size);
+    }
+
+    if (info.Length() > 1)
+    {
+        if (!info[1]->IsObject())
+        {
+            Nan::ThrowTypeError("optional second argument must be an options object");
+            return;
+        }
+        v8::Local<v8::Object> options = info[1]->ToObject();
+        if (options->Has(Nan::New("size").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("size").ToLocalChecked());
+            if (!param_val->IsNumber() || param_val->IntegerValue() < 1)
+            {
+                Nan::ThrowTypeError("option 'size' must be a positive integer");
+                return;
+            }
+            size = param_val->IntegerValue();
+        }
+    }
+
+    if (!m->acquire())
+    {
+        Nan::ThrowTypeError("MapPool: Map currently in use by another thread.");
+        return;
+    }
+    MapPool* p = nullptr;
+    try
+    {
+        p = new MapPool(*m->get(), static_cast<unsigned>(size));
+    }
+    catch (std::exception const& ex)
+    {
+        // LCOV_EXCL_START
+        m->release();
+        Nan::ThrowError(ex.what());
+        return;
+        // LCOV_EXCL_STOP
+    }
+    m->release();
+    p->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_GETTER(MapPool::get_prop)
+{
+    MapPool* p = Nan::ObjectWrap::Unwrap<MapPool>(info.Holder());
+    std::string a = TOSTR(property);
+    if (a == "size")
+    {
+        info.GetReturnValue().Set(Nan::New<v8::Number>(p->size()));
+    }
+    else if (a == "available")
+    {
+        info.GetReturnValue().Set(Nan::New<v8::Number>(p->available()));
+    }
+    else if (a == "pending")
+    {
+        info.GetReturnValue().Set(Nan::New<v8::Number>(p->pending()));
+    }
+}
+
+void MapPool::dispatch(map_pool_baton_t * closure)
+{
+    if (available_.empty())
+    {
+        pending_.push_back(closure);
+        return;
+    }
+    closure->map = available_.back();
+    available_.pop_back();
+    node_mapnik::queue_work(&closure->request, EIO_RenderImage, (uv_after_work_cb)EIO_AfterRenderImage, node_mapnik::WORK_CLASS_RENDER);
+}
+
+void MapPool::release(map_ptr const& map)
+{
+    available_.push_back(map);
+    if (!pending_.empty())
+    {
+        map_pool_baton_t * next = pending_.front();
+        pending_.pop_front();
+        dispatch(next);
+    }
+}
+
+/**
+ * Render to an image using the next free map in the pool. If every map is
+ * busy the request waits in a queue until one is released.
+ *
+ * @instance
+ * @name render
+ * @memberof MapPool
+ * @param {mapnik.Image} image - image to render into; its width and height
+ * define the size of the request
+ * @param {Object} [options={}]
+ * @param {Array<number>} [options.extent] - extent to render as `[minx, miny, maxx, maxy]`,
+ * defaults to the current extent of the source map. Like setting `Map.extent`, it is
+ * adjusted to the aspect ratio of the image according to the map's `aspect_fix_mode`
+ * @param {Number} [options.buffer_size=0] size of the buffer on the image
+ * @param {Number} [options.scale=1.0] scale the image
+ * @param {Number} [options.scale_denominator=0.0]
+ * @param {Number} [options.offset_x=0] pixel offset along the x-axis
+ * @param {Number} [options.offset_y=0] pixel offset along the y-axis
+ * @param {Object} [options.variables] key value pairs passed into Mapnik as variables
+ * @param {Function} callback - `function(err, image)`
+ */
+NAN_METHOD(MapPool::render)
+{
+    if (info.Length() < 2) {
+        Nan::ThrowTypeError("requires at least two arguments, a mapnik.Image, and a callback");
+        return;
+    }
+
+    if (!info[0]->IsObject()) {
+        Nan::ThrowTypeError("requires a mapnik.Image to be passed as first argument");
+        return;
+    }
+
+    v8::Local<v8::Object> obj = info[0]->ToObject();
+    if (obj->IsNull() || obj->IsUndefined() || !Nan::New(Image::constructor)->HasInstance(obj)) {
+        Nan::ThrowTypeError("requires a mapnik.Image to be passed as first argument");
+        return;
+    }
+
+    if (!info[info.Length()-1]->IsFunction()) {
+        Nan::ThrowTypeError("last argument must be a callback function");
+        return;
+    }
+
+    MapPool* p = Nan::ObjectWrap::Unwrap<MapPool>(info.Holder());
+    map_pool_baton_t *closure = new map_pool_baton_t();
+
+    if (info.Length() > 2) {
+
+        if (!info[1]->IsObject()) {
+            delete closure;
+            Nan::ThrowTypeError("optional second argument must be an options object");
+            return;
+        }
+
+        v8::Local<v8::Object> options = info[1]->ToObject();
+
+        if (options->Has(Nan::New("extent").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("extent").ToLocalChecked());
+            if (!bind_opt->IsArray()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'extent' must be an array of [minx,miny,maxx,maxy]");
+                return;
+            }
+            v8::Local<v8::Array> a = bind_opt.As<v8::Array>();
+            if (a->Length() != 4) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'extent' must be an array of [minx,miny,maxx,maxy]");
+                return;
+            }
+            closure->use_extent = true;
+            closure->extent.init(a->Get(0)->NumberValue(),
+                                 a->Get(1)->NumberValue(),
+                                 a->Get(2)->NumberValue(),
+                                 a->Get(3)->NumberValue());
+        }
+
+        if (options->Has(Nan::New("buffer_size").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("buffer_size").ToLocalChecked());
+            if (!bind_opt->IsNumber()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'buffer_size' must be a number");
+                return;
+            }
+            closure->buffer_size = bind_opt->IntegerValue();
+        }
+
+        if (options->Has(Nan::New("scale").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("scale").ToLocalChecked());
+            if (!bind_opt->IsNumber()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'scale' must be a number");
+                return;
+            }
+            closure->scale_factor = bind_opt->NumberValue();
+        }
+
+        if (options->Has(Nan::New("scale_denominator").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("scale_denominator").ToLocalChecked());
+            if (!bind_opt->IsNumber()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'scale_denominator' must be a number");
+                return;
+            }
+            closure->scale_denominator = bind_opt->NumberValue();
+        }
+
+        if (options->Has(Nan::New("offset_x").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("offset_x").ToLocalChecked());
+            if (!bind_opt->IsNumber()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'offset_x' must be a number");
+                return;
+            }
+            closure->offset_x = bind_opt->IntegerValue();
+        }
+
+        if (options->Has(Nan::New("offset_y").ToLocalChecked())) {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("offset_y").ToLocalChecked());
+            if (!bind_opt->IsNumber()) {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'offset_y' must be a number");
+                return;
+            }
+            closure->offset_y = bind_opt->IntegerValue();
+        }
+
+        if (options->Has(Nan::New("variables").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> bind_opt = options->Get(Nan::New("variables").ToLocalChecked());
+            if (!bind_opt->IsObject())
+            {
+                delete closure;
+                Nan::ThrowTypeError("optional arg 'variables' must be an object");
+                return;
+            }
+            object_to_container(closure->variables,bind_opt->ToObject());
+        }
+    }
+
+    closure->request.data = closure;
+    closure->p = p;
+    closure->im = Nan::ObjectWrap::Unwrap<Image>(obj);
+    closure->im->_ref();
+    closure->cb.Reset(info[info.Length() - 1].As<v8::Function>());
+    p->Ref();
+    p->dispatch(closure);
+}
+
+void MapPool::EIO_RenderImage(uv_work_t* req)
+{
+    map_pool_baton_t *closure = static_cast<map_pool_baton_t *>(req->data);
+
+    try
+    {
+        mapnik::Map const& map = *closure->map;
+        mapnik::image_any & im = *closure->im->get();
+        // The image need not match the size of the pooled maps, so fit the
+        // extent to the image the way zooming a map of that size would,
+        // using an empty map to apply the source map's aspect fix mode.
+        mapnik::Map fit(im.width(), im.height());
+        fit.set_aspect_fix_mode(map.get_aspect_fix_mode());
+        fit.zoom_to_box(closure->use_extent ? closure->extent : map.get_current_extent());
+        mapnik::request m_req(im.width(),
+                              im.height(),
+                              fit.get_current_extent());
+        m_req.set_buffer_size(closure->buffer_size);
+        node_mapnik::agg_renderer_visitor visit(map,
+                                                m_req,
+                                                closure->variables,
+                                                closure->scale_factor,
+                                                closure->offset_x,
+                                                closure->offset_y,
+                                                closure->scale_denominator);
+        mapnik::util::apply_visitor(visit, im);
+    }
+    catch (std::exception const& ex)
+    {
+        closure->error = true;
+        closure->error_name = ex.what();
+    }
+}
+
+void MapPool::EIO_AfterRenderImage(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    map_pool_baton_t *closure = static_cast<map_pool_baton_t *>(req->data);
+    // hand the map to the next queued request before calling back so that
+    // renders issued from within the callback queue behind it
+    closure->p->release(closure->map);
+    closure->map.reset();
+
+    if (closure->error) {
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+    } else {
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), closure->im->handle() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+
+    closure->p->Unref();
+    closure->im->_unref();
+    closure->cb.Reset();
+    delete closure;
+}
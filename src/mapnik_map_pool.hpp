@@ -0,0 +1,47 @@
+#ifndef __NODE_MAPNIK_MAP_POOL_H__
+#define __NODE_MAPNIK_MAP_POOL_H__
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wshadow"
+#include <nan.h>
+#pragma GCC diagnostic pop
+
+#include "mapnik_map.hpp"
+
+// stl
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct map_pool_baton_t;
+
+class MapPool: public Nan::ObjectWrap {
+public:
+    static Nan::Persistent<v8::FunctionTemplate> constructor;
+    static void Initialize(v8::Local<v8::Object> target);
+    static NAN_METHOD(New);
+
+    static NAN_METHOD(render);
+    static void EIO_RenderImage(uv_work_t* req);
+    static void EIO_AfterRenderImage(uv_work_t* req);
+
+    static NAN_GETTER(get_prop);
+
+    explicit MapPool(mapnik::Map const& map, unsigned size);
+
+    std::size_t size() const { return maps_.size(); }
+    std::size_t available() const { return available_.size(); }
+    std::size_t pending() const { return pending_.size(); }
+
+private:
+    ~MapPool();
+    void dispatch(map_pool_baton_t * closure);
+    void release(map_ptr const& map);
+
+    std::vector<map_ptr> maps_;
+    std::vector<map_ptr> available_;
+    std::deque<map_pool_baton_t *> pending_;
+};
+
+#endif
@@ -417,3 +417,37 @@ NAN_METHOD(ProjTransform::backward)
         }
     }
 }
+
+namespace node_mapnik {
+
+namespace {
+
+// intentionally leaked so that worker threads can still use them while the
+// process is shutting down
+mapnik::projection const& wgs84()
+{
+    static mapnik::projection const* proj = new mapnik::projection("+init=epsg:4326", true);
+    return *proj;
+}
+
+mapnik::projection const& merc()
+{
+    static mapnik::projection const* proj = new mapnik::projection("+init=epsg:3857", true);
+    return *proj;
+}
+
+} // end anonymous ns
+
+mapnik::proj_transform const& wgs84_to_merc()
+{
+    static mapnik::proj_transform const* tr = new mapnik::proj_transform(wgs84(), merc());
+    return *tr;
+}
+
+mapnik::proj_transform const& merc_to_wgs84()
+{
+    static mapnik::proj_transform const* tr = new mapnik::proj_transform(merc(), wgs84());
+    return *tr;
+}
+
+} // end ns
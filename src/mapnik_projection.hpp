@@ -60,6 +60,16 @@ private:
     proj_tr_ptr this_;
 };
 
+namespace node_mapnik {
+
+// Process wide transforms between WGS84 and spherical mercator. Mapnik
+// recognizes both projections and converts between them with its own math
+// instead of proj4, so these are safe to share between threads.
+mapnik::proj_transform const& wgs84_to_merc();
+mapnik::proj_transform const& merc_to_wgs84();
+
+} // end ns
+
 
 #endif
 
@@ -0,0 +1,345 @@
+#include "mapnik_stylesheet_cache.hpp"
+
+#include <mapnik/box2d.hpp>
+#include <mapnik/color.hpp>
+#include <mapnik/load_map.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/util/variant.hpp>
+
+// stl
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace node_mapnik {
+
+namespace {
+
+typedef std::shared_ptr<mapnik::Map const> cached_map_ptr;
+
+class stylesheet_cache
+{
+public:
+    stylesheet_cache()
+        : capacity_(0),
+          hits_(0),
+          misses_(0) {}
+
+    bool enabled() const
+    {
+        return capacity_.load() > 0;
+    }
+
+    cached_map_ptr get(std::string const& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto itr = index_.find(key);
+        if (itr == index_.end())
+        {
+            ++misses_;
+            return cached_map_ptr();
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, itr->second);
+        return itr->second->second;
+    }
+
+    void put(std::string const& key, cached_map_ptr const& map)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_.load() == 0 || index_.find(key) != index_.end())
+        {
+            return;
+        }
+        entries_.emplace_front(key, map);
+        index_.emplace(key, entries_.begin());
+        evict();
+    }
+
+    void resize(std::size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_.store(capacity);
+        evict();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_.clear();
+        entries_.clear();
+    }
+
+    void stats(std::size_t & capacity, std::size_t & entries,
+               std::size_t & hits, std::size_t & misses)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity = capacity_.load();
+        entries = index_.size();
+        hits = hits_;
+        misses = misses_;
+    }
+
+private:
+    // Drops the least recently used maps until the cache fits.
+    void evict()
+    {
+        while (index_.size() > capacity_.load())
+        {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    typedef std::list<std::pair<std::string, cached_map_ptr> > entry_list;
+
+    std::mutex mutex_;
+    std::atomic<std::size_t> capacity_;
+    std::size_t hits_;
+    std::size_t misses_;
+    entry_list entries_;
+    std::unordered_map<std::string, entry_list::iterator> index_;
+};
+
+stylesheet_cache & get_stylesheet_cache()
+{
+    static stylesheet_cache cache;
+    return cache;
+}
+
+void append_string(std::string & key, std::string const& value)
+{
+    std::uint64_t size = value.size();
+    key.append(reinterpret_cast<char const*>(&size), sizeof(size));
+    key.append(value);
+}
+
+struct parameter_writer
+{
+    explicit parameter_writer(std::ostringstream & s)
+        : s_(s) {}
+
+    void operator() (mapnik::value_null const&) const
+    {
+        s_ << 'n';
+    }
+
+    void operator() (mapnik::value_bool val) const
+    {
+        s_ << 'b' << val;
+    }
+
+    void operator() (mapnik::value_integer val) const
+    {
+        s_ << 'i' << val;
+    }
+
+    void operator() (mapnik::value_double val) const
+    {
+        s_ << 'd' << val;
+    }
+
+    void operator() (std::string const& val) const
+    {
+        s_ << 's' << val.size() << ':' << val;
+    }
+
+    std::ostringstream & s_;
+};
+
+// The settings of a map that loading a stylesheet may leave untouched, and
+// that therefore end up in the loaded map.
+void append_map_settings(std::string & key, mapnik::Map const& map)
+{
+    std::ostringstream s;
+    s.precision(17);
+    s << map.srs() << '\n' << map.buffer_size() << '\n';
+    s << map.get_aspect_fix_mode() << '\n';
+    for (auto const& param : map.get_extra_parameters())
+    {
+        s << param.first.size() << ':' << param.first;
+        mapnik::util::apply_visitor(parameter_writer(s), param.second);
+        s << '\n';
+    }
+    if (map.background())
+    {
+        s << map.background()->to_string();
+    }
+    s << '\n';
+    if (map.maximum_extent())
+    {
+        s << *map.maximum_extent();
+    }
+    s << '\n';
+    if (map.font_directory())
+    {
+        s << *map.font_directory();
+    }
+    append_string(key, s.str());
+}
+
+void load_map_uncached(mapnik::Map & map,
+                       std::string const& stylesheet,
+                       bool from_string,
+                       bool strict,
+                       std::string const& base_path)
+{
+    if (from_string)
+    {
+        mapnik::load_map_string(map, stylesheet, strict, base_path);
+    }
+    else
+    {
+        mapnik::load_map(map, stylesheet, strict, base_path);
+    }
+}
+
+} // end anonymous ns
+
+void load_map_cached(mapnik::Map & map,
+                     std::string const& stylesheet,
+                     bool from_string,
+                     bool strict,
+                     std::string const& base_path)
+{
+    stylesheet_cache & cache = get_stylesheet_cache();
+    if (!cache.enabled() ||
+        !map.layers().empty() ||
+        !map.styles().empty() ||
+        !map.fontsets().empty())
+    {
+        load_map_uncached(map, stylesheet, from_string, strict, base_path);
+        return;
+    }
+
+    std::string key;
+    key.push_back(from_string ? 's' : 'f');
+    key.push_back(strict ? '1' : '0');
+    append_string(key, base_path);
+    append_map_settings(key, map);
+    if (from_string)
+    {
+        append_string(key, stylesheet);
+    }
+    else
+    {
+        // Relative paths inside the stylesheet resolve against its location,
+        // so the path is part of the key along with the file contents.
+        std::ifstream file(stylesheet.c_str(), std::ios::in | std::ios::binary);
+        if (!file)
+        {
+            load_map_uncached(map, stylesheet, from_string, strict, base_path);
+            return;
+        }
+        append_string(key, stylesheet);
+        key.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    cached_map_ptr loaded = cache.get(key);
+    if (!loaded)
+    {
+        std::shared_ptr<mapnik::Map> fresh = std::make_shared<mapnik::Map>(map);
+        load_map_uncached(*fresh, stylesheet, from_string, strict, base_path);
+        cache.put(key, fresh);
+        loaded = fresh;
+    }
+    unsigned width = map.width();
+    unsigned height = map.height();
+    mapnik::box2d<double> extent = map.get_current_extent();
+    map = *loaded;
+    map.resize(width, height);
+    if (extent.valid())
+    {
+        map.zoom_to_box(extent);
+    }
+}
+
+/**
+ * Keep the maps loaded by `Map.load`, `Map.loadSync`, `Map.fromString` and
+ * `Map.fromStringSync` in a cache so that loading the same stylesheet into
+ * another new map copies the earlier result instead of parsing the XML and
+ * creating its datasources again. Entries are keyed by the stylesheet
+ * contents, the load options and the settings of the map loaded into
+ * (`srs`, `bufferSize`, `background`, `maximumExtent`, `aspect_fix_mode`,
+ * `parameters` and the font directory), and maps copied from the cache
+ * share their datasources. Only maps without
+ * layers, styles or fontsets are loaded through the cache. The least
+ * recently used entries are dropped once there are more than `size`. The
+ * cache is disabled by default and setting `size` to `0` disables and
+ * empties it.
+ *
+ * @name setStylesheetCache
+ * @memberof mapnik
+ * @static
+ * @param {Object} options
+ * @param {number} options.size - maximum number of loaded stylesheets kept
+ * @example
+ * mapnik.setStylesheetCache({size: 16});
+ */
+NAN_METHOD(setStylesheetCache)
+{
+    if (info.Length() != 1 || !info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("requires an options object, eg. {size: 16}");
+        return;
+    }
+    v8::Local<v8::Object> options = info[0]->ToObject();
+    v8::Local<v8::String> param = Nan::New("size").ToLocalChecked();
+    if (!options->Has(param))
+    {
+        Nan::ThrowTypeError("option 'size' is required");
+        return;
+    }
+    v8::Local<v8::Value> param_val = options->Get(param);
+    if (!param_val->IsNumber() || param_val->IntegerValue() < 0)
+    {
+        Nan::ThrowTypeError("option 'size' must be a non-negative integer");
+        return;
+    }
+    get_stylesheet_cache().resize(static_cast<std::size_t>(param_val->IntegerValue()));
+    return;
+}
+
+/**
+ * Drop every map held by the cache set up with `mapnik.setStylesheetCache`,
+ * for instance after the files a stylesheet refers to have changed.
+ *
+ * @name clearStylesheetCache
+ * @memberof mapnik
+ * @static
+ */
+NAN_METHOD(clearStylesheetCache)
+{
+    get_stylesheet_cache().clear();
+    return;
+}
+
+/**
+ * Report the state of the cache set up with `mapnik.setStylesheetCache`.
+ *
+ * @name stylesheetCacheStats
+ * @memberof mapnik
+ * @static
+ * @returns {Object} `size` (the limit), the number of `entries` currently
+ * held, and the number of `hits` and `misses` so far
+ */
+NAN_METHOD(stylesheetCacheStats)
+{
+    std::size_t capacity, entries, hits, misses;
+    get_stylesheet_cache().stats(capacity, entries, hits, misses);
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    stats->Set(Nan::New("size").ToLocalChecked(), Nan::New<v8::Number>(capacity));
+    stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New<v8::Number>(entries));
+    stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New<v8::Number>(hits));
+    stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New<v8::Number>(misses));
+    info.GetReturnValue().Set(stats);
+}
+
+} // end ns
@@ -0,0 +1,37 @@
+#ifndef __NODE_MAPNIK_STYLESHEET_CACHE_H__
+#define __NODE_MAPNIK_STYLESHEET_CACHE_H__
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wshadow"
+#include <nan.h>
+#pragma GCC diagnostic pop
+
+#include <mapnik/map.hpp>
+
+// stl
+#include <string>
+
+namespace node_mapnik {
+
+// Loads a stylesheet into `map` like `mapnik::load_map` (`stylesheet` is a
+// path) or `mapnik::load_map_string` (`from_string`, `stylesheet` is the XML).
+//
+// Once `mapnik.setStylesheetCache` gives the process wide cache a size, a
+// map without layers, styles or fontsets is instead copied from an earlier
+// load of the same XML content, options and map settings, sharing its
+// datasources; only its size and extent are kept. Other maps are loaded as
+// usual since loading would add to what they already hold.
+void load_map_cached(mapnik::Map & map,
+                     std::string const& stylesheet,
+                     bool from_string,
+                     bool strict,
+                     std::string const& base_path);
+
+NAN_METHOD(setStylesheetCache);
+NAN_METHOD(clearStylesheetCache);
+NAN_METHOD(stylesheetCacheStats);
+
+} // end ns
+
+#endif
@@ -0,0 +1,417 @@
+#include "mapnik_thread_pool.hpp"
+#include "utils.hpp"
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace node_mapnik {
+
+namespace {
+
+struct work_item
+{
+    uv_work_t* req;
+    uv_work_cb work;
+    uv_after_work_cb after;
+};
+
+// Finished work is handed back to the main loop through a single uv_async_t.
+// The handle is unref'd whenever nothing is in flight so that it does not
+// keep the process alive on its own.
+struct completion_queue
+{
+    completion_queue() :
+        async(),
+        mutex(),
+        done(),
+        outstanding(0),
+        initialized(false) {}
+
+    uv_async_t async;
+    std::mutex mutex;
+    std::vector<work_item> done;
+    std::size_t outstanding; // only touched on the main thread
+    bool initialized;
+};
+
+completion_queue & completions()
+{
+    // intentionally leaked: the async handle lives for the whole process
+    static completion_queue * queue = new completion_queue();
+    return *queue;
+}
+
+void after_work(uv_async_t* handle)
+{
+    completion_queue & q = *static_cast<completion_queue *>(handle->data);
+    std::vector<work_item> done;
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        done.swap(q.done);
+    }
+    for (work_item const& item : done)
+    {
+        --q.outstanding;
+        item.after(item.req, 0);
+    }
+    if (q.outstanding == 0)
+    {
+        uv_unref(reinterpret_cast<uv_handle_t *>(&q.async));
+    }
+}
+
+class executor
+{
+public:
+    executor() :
+        threads_(),
+        queue_(),
+        mutex_(),
+        cv_(),
+        stop_(false) {}
+
+    std::size_t size() const
+    {
+        return threads_.size();
+    }
+
+    // Only called from the main thread while no work is in flight, so
+    // joining the current threads does not block on running jobs.
+    void resize(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread & t : threads_)
+        {
+            t.join();
+        }
+        threads_.clear();
+        stop_ = false;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            threads_.emplace_back(&executor::run, this);
+        }
+    }
+
+    void push(work_item const& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(item);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            work_item item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                item = queue_.front();
+                queue_.pop_front();
+            }
+            item.work(item.req);
+            completion_queue & q = completions();
+            {
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.done.push_back(item);
+            }
+            uv_async_send(&q.async);
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<work_item> queue_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+};
+
+executor & get_executor(WorkClass work_class)
+{
+    // intentionally leaked: joining threads during static destruction at
+    // process exit could block on a job that is still running
+    static executor * executors = new executor[WORK_CLASS_MAX];
+    return executors[work_class];
+}
+
+// The tasks of one parallel_for call. The caller and every helper that picks
+// the batch up claim task indices from `next` until there are none left.
+struct parallel_batch
+{
+    parallel_batch(std::size_t _count, std::function<void(std::size_t)> const& _fn) :
+        fn(_fn),
+        count(_count),
+        next(0),
+        finished(0),
+        failed(false),
+        error(),
+        mutex(),
+        cv() {}
+
+    void work()
+    {
+        for (std::size_t i = next++; i < count; i = next++)
+        {
+            if (!failed)
+            {
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+            if (++finished == count)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cv.notify_all();
+            }
+        }
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return finished == count; });
+    }
+
+    // only dereferenced for claimed tasks, which the caller waits for
+    std::function<void(std::size_t)> const& fn;
+    std::size_t const count;
+    std::atomic<std::size_t> next;
+    std::atomic<std::size_t> finished;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+class helper_pool
+{
+public:
+    helper_pool() :
+        threads_(),
+        queue_(),
+        mutex_(),
+        cv_()
+    {
+        std::size_t size = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            threads_.emplace_back(&helper_pool::run, this);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return threads_.size();
+    }
+
+    void push(std::shared_ptr<parallel_batch> const& batch, std::size_t helpers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < helpers; ++i)
+            {
+                queue_.push_back(batch);
+            }
+        }
+        if (helpers == 1)
+        {
+            cv_.notify_one();
+        }
+        else
+        {
+            cv_.notify_all();
+        }
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::shared_ptr<parallel_batch> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return !queue_.empty(); });
+                batch = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            // a no-op if the caller already ran out of tasks
+            batch->work();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<std::shared_ptr<parallel_batch>> queue_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+helper_pool & get_helper_pool()
+{
+    // intentionally leaked, see get_executor
+    static helper_pool * pool = new helper_pool();
+    return *pool;
+}
+
+} // end anonymous ns
+
+void queue_work(uv_work_t* req, uv_work_cb work, uv_after_work_cb after, WorkClass work_class)
+{
+    executor & ex = get_executor(work_class);
+    if (ex.size() == 0)
+    {
+        uv_queue_work(uv_default_loop(), req, work, after);
+        return;
+    }
+    completion_queue & q = completions();
+    if (q.outstanding++ == 0)
+    {
+        uv_ref(reinterpret_cast<uv_handle_t *>(&q.async));
+    }
+    ex.push(work_item{req, work, after});
+}
+
+void parallel_for(std::size_t count, std::size_t max_threads, std::function<void(std::size_t)> const& fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (count == 1 || max_threads <= 1)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            fn(i);
+        }
+        return;
+    }
+    helper_pool & pool = get_helper_pool();
+    std::size_t helpers = std::min(std::min(max_threads, count) - 1, pool.size());
+    std::shared_ptr<parallel_batch> batch = std::make_shared<parallel_batch>(count, fn);
+    pool.push(batch, helpers);
+    batch->work();
+    batch->wait();
+    if (batch->error)
+    {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+/**
+ * Move classes of asynchronous work off the libuv default threadpool onto
+ * dedicated native threads. By default everything runs on the libuv pool
+ * (sized by `UV_THREADPOOL_SIZE`) which is shared with filesystem and DNS
+ * work. Setting a class to `0` sends it back to the libuv pool.
+ *
+ * The `render` class covers `Map.render`, `Map.renderFile`, `MapPool.render`,
+ * `VectorTile.render` and `VectorTile.composite`. The `encode` class covers
+ * `Image.encode`, `ImageView.encode`, `VectorTile.getData` and `mapnik.blend`.
+ *
+ * The pool cannot be resized while work queued on it is still in flight, so
+ * this is best called once at startup.
+ *
+ * @name setThreadPool
+ * @memberof mapnik
+ * @static
+ * @param {Object} options
+ * @param {number} [options.render] - number of threads for rendering, at most 256
+ * @param {number} [options.encode] - number of threads for encoding, at most 256
+ * @throws {Error} if work is in flight on the dedicated threads or the threads
+ * cannot be started
+ * @example
+ * mapnik.setThreadPool({render: 8, encode: 4});
+ */
+NAN_METHOD(setThreadPool)
+{
+    if (info.Length() != 1 || !info[0]->IsObject())
+    {
+        Nan::ThrowTypeError("requires an options object, eg. {render: 8, encode: 4}");
+        return;
+    }
+    v8::Local<v8::Object> options = info[0]->ToObject();
+
+    static char const* names[WORK_CLASS_MAX] = { "render", "encode" };
+    std::size_t sizes[WORK_CLASS_MAX];
+    for (int i = 0; i < WORK_CLASS_MAX; ++i)
+    {
+        sizes[i] = get_executor(static_cast<WorkClass>(i)).size();
+        v8::Local<v8::String> param = Nan::New(names[i]).ToLocalChecked();
+        if (options->Has(param))
+        {
+            v8::Local<v8::Value> param_val = options->Get(param);
+            if (!param_val->IsNumber() || param_val->IntegerValue() < 0 || param_val->IntegerValue() > 256)
+            {
+                std::string msg = std::string("option '") + names[i] + "' must be an integer between 0 and 256";
+                Nan::ThrowTypeError(msg.c_str());
+                return;
+            }
+            sizes[i] = static_cast<std::size_t>(param_val->IntegerValue());
+        }
+    }
+
+    completion_queue & q = completions();
+    if (q.outstanding > 0)
+    {
+        Nan::ThrowError("thread pool cannot be resized while work is in progress");
+        return;
+    }
+    if (!q.initialized)
+    {
+        uv_async_init(uv_default_loop(), &q.async, after_work);
+        q.async.data = &q;
+        uv_unref(reinterpret_cast<uv_handle_t *>(&q.async));
+        q.initialized = true;
+    }
+    for (int i = 0; i < WORK_CLASS_MAX; ++i)
+    {
+        executor & pool = get_executor(static_cast<WorkClass>(i));
+        if (pool.size() != sizes[i])
+        {
+            try
+            {
+                pool.resize(sizes[i]);
+            }
+            catch (std::exception const& ex)
+            {
+                // the system refused to start more threads; the ones that
+                // did start keep serving this class
+                Nan::ThrowError(ex.what());
+                return;
+            }
+        }
+    }
+    return;
+}
+
+} // end ns
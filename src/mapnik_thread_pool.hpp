@@ -0,0 +1,43 @@
+#ifndef __NODE_MAPNIK_THREAD_POOL_H__
+#define __NODE_MAPNIK_THREAD_POOL_H__
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wshadow"
+#include <nan.h>
+#pragma GCC diagnostic pop
+
+// stl
+#include <cstddef>
+#include <functional>
+
+namespace node_mapnik {
+
+// Classes of work that can be moved off the libuv default threadpool
+// with `mapnik.setThreadPool`. Anything else stays on the default pool.
+enum WorkClass {
+    WORK_CLASS_RENDER,
+    WORK_CLASS_ENCODE,
+    WORK_CLASS_MAX
+};
+
+// Drop-in replacement for `uv_queue_work(uv_default_loop(), ...)`. When no
+// dedicated threads are configured for `work_class` the request goes to the
+// libuv default threadpool, otherwise `work` runs on the dedicated threads
+// and `after` is called on the main loop exactly like uv_queue_work would.
+void queue_work(uv_work_t* req, uv_work_cb work, uv_after_work_cb after, WorkClass work_class);
+
+// Runs `fn(i)` for every `i` in `[0, count)` from inside a worker job and
+// returns once all of them are done. The calling thread takes tasks itself and
+// up to `max_threads - 1` threads of a shared helper pool, sized to the number
+// of cores, steal the rest. Because the helpers are shared, jobs running at
+// the same time never add up to more threads than the machine has cores. The
+// first exception thrown by `fn` is rethrown after all tasks have finished;
+// tasks that had not started by then are skipped.
+void parallel_for(std::size_t count, std::size_t max_threads, std::function<void(std::size_t)> const& fn);
+
+NAN_METHOD(setThreadPool);
+
+} // end ns
+
+#endif // __NODE_MAPNIK_THREAD_POOL_H__
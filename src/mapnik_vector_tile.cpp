@@ -5,12 +5,16 @@
 #include "mapnik_grid.hpp"
 #endif
 #include "mapnik_feature.hpp"
+#include "mapnik_projection.hpp"
 #include "mapnik_cairo_surface.hpp"
+#include "mapnik_thread_pool.hpp"
 #ifdef SVG_RENDERER
 #include <mapnik/svg/output/svg_renderer.hpp>
 #endif
 
 #include "mapnik_vector_tile.hpp"
+#include "mapnik_vector_tile_index.hpp"
+#include "mapnik_vector_tile_geojson.hpp"
 #include "vector_tile_compression.hpp"
 #include "vector_tile_composite.hpp"
 #include "vector_tile_processor.hpp"
@@ -59,6 +63,7 @@
 #include <sstream>                      // for operator<<, basic_ostream, etc
 #include <string>                       // for string, char_traits, etc
 #include <exception>                    // for exception
+#include <limits>
 #include <vector>                       // for vector
 
 // protozero
@@ -292,6 +297,7 @@ void VectorTile::Initialize(v8::Local<v8::Object> target)
     Nan::SetPrototypeMethod(lcons, "toJSON", toJSON);
     Nan::SetPrototypeMethod(lcons, "toGeoJSON", toGeoJSON);
     Nan::SetPrototypeMethod(lcons, "toGeoJSONSync", toGeoJSONSync);
+    Nan::SetPrototypeMethod(lcons, "toGeoJSONReader", toGeoJSONReader);
     Nan::SetPrototypeMethod(lcons, "addGeoJSON", addGeoJSON);
     Nan::SetPrototypeMethod(lcons, "addImage", addImage);
     Nan::SetPrototypeMethod(lcons, "addImageSync", addImageSync);
@@ -327,15 +333,64 @@ VectorTile::VectorTile(std::uint64_t z,
                        std::uint32_t tile_size,
                        std::int32_t buffer_size) :
     Nan::ObjectWrap(),
-    tile_(std::make_shared<mapnik::vector_tile_impl::merc_tile>(x, y, z, tile_size, buffer_size))
+    tile_(std::make_shared<mapnik::vector_tile_impl::merc_tile>(x, y, z, tile_size, buffer_size)),
+    data_snapshot_(),
+    index_(),
+    index_generation_(0),
+    index_mutex_()
 {
 }
 
+std::shared_ptr<node_mapnik::vector_tile_index const> VectorTile::get_index()
+{
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        if (index_)
+        {
+            return index_;
+        }
+        generation = index_generation_;
+    }
+    // Building the index decodes every feature, so it is done without the
+    // lock that `reset_cache` takes on the main thread. Concurrent callers
+    // may each build one; the first to finish is kept.
+    auto index = std::make_shared<node_mapnik::vector_tile_index const>(*tile_);
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    if (generation != index_generation_)
+    {
+        // the tile changed while building, so this index is only good for
+        // the caller that asked for it
+        return index;
+    }
+    if (!index_)
+    {
+        index_ = index;
+    }
+    return index_;
+}
+
+v8::Local<v8::Object> VectorTile::data_snapshot()
+{
+    Nan::EscapableHandleScope scope;
+    if (data_snapshot_.IsEmpty())
+    {
+        std::string * data = new std::string(tile_->data(), tile_->size());
+        v8::Local<v8::Object> buffer = Nan::NewBuffer(&(*data)[0],
+                                                      data->size(),
+                                                      node_mapnik::delete_buffer_owner<std::string>,
+                                                      data).ToLocalChecked();
+        data_snapshot_.Reset(buffer);
+    }
+    return scope.Escape(Nan::New(data_snapshot_));
+}
+
 // For some reason coverage never seems to be considered here even though
 // I have tested it and it does print
 /* LCOV_EXCL_START */
 VectorTile::~VectorTile()
 { 
+    data_snapshot_.Reset();
 }
 /* LCOV_EXCL_STOP */
 
@@ -794,6 +849,7 @@ v8::Local<v8::Value> VectorTile::_compositeSync(Nan::NAN_METHOD_ARGS_TYPE info)
     }
     try
     {
+        target_vt->reset_cache();
         _composite(target_vt,
                    vtiles_vec,
                    scale_factor,
@@ -1205,7 +1261,7 @@ NAN_METHOD(VectorTile::composite)
     }
     closure->d->Ref();
     closure->cb.Reset(callback.As<v8::Function>());
-    uv_queue_work(uv_default_loop(), &closure->request, EIO_Composite, (uv_after_work_cb)EIO_AfterComposite);
+    node_mapnik::queue_work(&closure->request, EIO_Composite, (uv_after_work_cb)EIO_AfterComposite, node_mapnik::WORK_CLASS_RENDER);
     return;
 }
 
@@ -1243,6 +1299,7 @@ void VectorTile::EIO_AfterComposite(uv_work_t* req)
 {
     Nan::HandleScope scope;
     vector_tile_composite_baton_t *closure = static_cast<vector_tile_composite_baton_t *>(req->data);
+    closure->d->reset_cache();
 
     if (closure->error)
     {
@@ -1680,9 +1737,7 @@ std::vector<query_result> VectorTile::_query(VectorTile* d, double lon, double l
         return arr;
     }
 
-    mapnik::projection wgs84("+init=epsg:4326",true);
-    mapnik::projection merc("+init=epsg:3857",true);
-    mapnik::proj_transform tr(wgs84,merc);
+    mapnik::proj_transform const& tr = node_mapnik::wgs84_to_merc();
     double x = lon;
     double y = lat;
     double z = 0;
@@ -1695,81 +1750,47 @@ std::vector<query_result> VectorTile::_query(VectorTile* d, double lon, double l
         /* LCOV_EXCL_STOP */
     }
 
-    mapnik::coord2d pt(x,y);
+    mapnik::box2d<double> box(x, y, x, y);
+    box.pad(tolerance);
+    std::shared_ptr<node_mapnik::vector_tile_index const> index = d->get_index();
+    std::vector<node_mapnik::indexed_layer const*> layers;
     if (!layer_name.empty())
     {
-        protozero::pbf_reader layer_msg;
-        if (d->tile_->layer_reader(layer_name, layer_msg))
+        node_mapnik::indexed_layer const* layer = index->find(layer_name);
+        if (layer)
         {
-            auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
-                                            layer_msg,
-                                            d->tile_->x(),
-                                            d->tile_->y(),
-                                            d->tile_->z());
-            mapnik::featureset_ptr fs = ds->features_at_point(pt, tolerance);
-            if (fs && mapnik::is_valid(fs))
-            {
-                mapnik::feature_ptr feature;
-                while ((feature = fs->next()))
-                {
-                    auto const& geom = feature->get_geometry();
-                    auto p2p = path_to_point_distance(geom,x,y);
-                    if (!tr.backward(p2p.x_hit,p2p.y_hit,z))
-                    {
-                        /* LCOV_EXCL_START */
-                        throw std::runtime_error("could not reproject lon/lat to mercator");
-                        /* LCOV_EXCL_STOP */
-                    }
-                    if (p2p.distance >= 0 && p2p.distance <= tolerance)
-                    {
-                        query_result res;
-                        res.x_hit = p2p.x_hit;
-                        res.y_hit = p2p.y_hit;
-                        res.distance = p2p.distance;
-                        res.layer = layer_name;
-                        res.feature = feature;
-                        arr.push_back(std::move(res));
-                    }
-                }
-            }
+            layers.push_back(layer);
         }
     }
     else
     {
-        protozero::pbf_reader item(d->tile_->get_reader());
-        while (item.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+        for (node_mapnik::indexed_layer const& layer : index->layers())
+        {
+            layers.push_back(&layer);
+        }
+    }
+    for (node_mapnik::indexed_layer const* layer : layers)
+    {
+        for (std::size_t pos : layer->query(box))
         {
-            protozero::pbf_reader layer_msg = item.get_message();
-            auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
-                                            layer_msg,
-                                            d->tile_->x(),
-                                            d->tile_->y(),
-                                            d->tile_->z());
-            mapnik::featureset_ptr fs = ds->features_at_point(pt,tolerance);
-            if (fs && mapnik::is_valid(fs))
+            mapnik::feature_ptr const& feature = layer->features[pos];
+            auto const& geom = feature->get_geometry();
+            auto p2p = path_to_point_distance(geom,x,y);
+            if (!tr.backward(p2p.x_hit,p2p.y_hit,z))
             {
-                mapnik::feature_ptr feature;
-                while ((feature = fs->next()))
-                {
-                    auto const& geom = feature->get_geometry();
-                    auto p2p = path_to_point_distance(geom,x,y);
-                    if (!tr.backward(p2p.x_hit,p2p.y_hit,z))
-                    {
-                        /* LCOV_EXCL_START */
-                        throw std::runtime_error("could not reproject lon/lat to mercator");
-                        /* LCOV_EXCL_STOP */
-                    }
-                    if (p2p.distance >= 0 && p2p.distance <= tolerance)
-                    {
-                        query_result res;
-                        res.x_hit = p2p.x_hit;
-                        res.y_hit = p2p.y_hit;
-                        res.distance = p2p.distance;
-                        res.layer = ds->get_name();
-                        res.feature = feature;
-                        arr.push_back(std::move(res));
-                    }
-                }
+                /* LCOV_EXCL_START */
+                throw std::runtime_error("could not reproject lon/lat to mercator");
+                /* LCOV_EXCL_STOP */
+            }
+            if (p2p.distance >= 0 && p2p.distance <= tolerance)
+            {
+                query_result res;
+                res.x_hit = p2p.x_hit;
+                res.y_hit = p2p.y_hit;
+                res.distance = p2p.distance;
+                res.layer = layer->name;
+                res.feature = feature;
+                arr.push_back(std::move(res));
             }
         }
     }
@@ -1980,6 +2001,24 @@ NAN_METHOD(VectorTile::queryMany)
     }
 }
 
+// Copy of `feature` that only carries the attributes in `fields`, like the
+// features a datasource returns when asked for those property names.
+static mapnik::feature_ptr select_fields(mapnik::feature_ptr const& feature,
+                                         mapnik::context_ptr const& ctx,
+                                         std::set<std::string> const& fields)
+{
+    mapnik::feature_ptr selected = std::make_shared<mapnik::feature_impl>(ctx, feature->id());
+    selected->set_geometry_copy(feature->get_geometry());
+    for (std::string const& name : fields)
+    {
+        if (feature->has_key(name))
+        {
+            selected->put(name, feature->get(name));
+        }
+    }
+    return selected;
+}
+
 void VectorTile::_queryMany(queryMany_result & result, 
                             VectorTile* d, 
                             std::vector<query_lonlat> const& query, 
@@ -1987,8 +2026,9 @@ void VectorTile::_queryMany(queryMany_result & result,
                             std::string const& layer_name, 
                             std::vector<std::string> const& fields)
 {
-    protozero::pbf_reader layer_msg;
-    if (!d->tile_->layer_reader(layer_name,layer_msg))
+    std::shared_ptr<node_mapnik::vector_tile_index const> index = d->get_index();
+    node_mapnik::indexed_layer const* layer = index->find(layer_name);
+    if (!layer)
     {
         throw std::runtime_error("Could not find layer in vector tile");
     }
@@ -1997,10 +2037,7 @@ void VectorTile::_queryMany(queryMany_result & result,
     std::map<unsigned,std::vector<query_hit> > hits;
 
     // Reproject query => mercator points
-    mapnik::box2d<double> bbox;
-    mapnik::projection wgs84("+init=epsg:4326",true);
-    mapnik::projection merc("+init=epsg:3857",true);
-    mapnik::proj_transform tr(wgs84,merc);
+    mapnik::proj_transform const& tr = node_mapnik::wgs84_to_merc();
     std::vector<mapnik::coord2d> points;
     points.reserve(query.size());
     for (std::size_t p = 0; p < query.size(); ++p)
@@ -2014,83 +2051,57 @@ void VectorTile::_queryMany(queryMany_result & result,
             throw std::runtime_error("could not reproject lon/lat to mercator");
             /* LCOV_EXCL_STOP */
         }
-        mapnik::coord2d pt(x,y);
-        bbox.expand_to_include(pt);
-        points.emplace_back(std::move(pt));
+        points.emplace_back(x,y);
     }
-    bbox.pad(tolerance);
 
-    std::shared_ptr<mapnik::vector_tile_impl::tile_datasource_pbf> ds = std::make_shared<
-                                mapnik::vector_tile_impl::tile_datasource_pbf>(
-                                    layer_msg,
-                                    d->tile_->x(),
-                                    d->tile_->y(),
-                                    d->tile_->z());
-    mapnik::query q(bbox);
-    if (fields.empty())
+    // feature position in layer => (point, distance) of each hit, ordered
+    // by feature and then by point
+    std::map<std::size_t, std::vector<std::pair<std::size_t, double> > > feature_hits;
+    for (std::size_t p = 0; p < points.size(); ++p)
     {
-        // request all data attributes
-        auto fields2 = ds->get_descriptor().get_descriptors();
-        for (auto const& field : fields2)
+        mapnik::coord2d const& pt = points[p];
+        mapnik::box2d<double> box(pt.x, pt.y, pt.x, pt.y);
+        box.pad(tolerance);
+        for (std::size_t pos : layer->query(box))
         {
-            q.add_property_name(field.get_name());
+            auto const& geom = layer->features[pos]->get_geometry();
+            auto p2p = path_to_point_distance(geom,pt.x,pt.y);
+            if (p2p.distance >= 0 && p2p.distance <= tolerance)
+            {
+                feature_hits[pos].emplace_back(p, p2p.distance);
+            }
         }
     }
-    else
+
+    mapnik::context_ptr ctx;
+    std::set<std::string> field_set(fields.begin(), fields.end());
+    if (!fields.empty())
     {
-        for (std::string const& name : fields)
+        ctx = std::make_shared<mapnik::context_type>();
+        for (std::string const& name : field_set)
         {
-            q.add_property_name(name);
+            ctx->push(name);
         }
     }
-    mapnik::featureset_ptr fs = ds->features(q);
 
-    if (fs && mapnik::is_valid(fs))
+    unsigned idx = 0;
+    for (auto const& feature_hit : feature_hits)
     {
-        mapnik::feature_ptr feature;
-        unsigned idx = 0;
-        while ((feature = fs->next()))
-        {
-            unsigned has_hit = 0;
-            for (std::size_t p = 0; p < points.size(); ++p)
-            {
-                mapnik::coord2d const& pt = points[p];
-                auto const& geom = feature->get_geometry();
-                auto p2p = path_to_point_distance(geom,pt.x,pt.y);
-                if (p2p.distance >= 0 && p2p.distance <= tolerance)
-                {
-                    has_hit = 1;
-                    query_result res;
-                    res.feature = feature;
-                    res.distance = 0;
-                    res.layer = ds->get_name();
-
-                    query_hit hit;
-                    hit.distance = p2p.distance;
-                    hit.feature_id = idx;
+        mapnik::feature_ptr const& feature = layer->features[feature_hit.first];
+        query_result res;
+        res.feature = fields.empty() ? feature : select_fields(feature, ctx, field_set);
+        res.distance = 0;
+        res.layer = layer->name;
+        features.insert(std::make_pair(idx, res));
 
-                    features.insert(std::make_pair(idx, res));
-
-                    std::map<unsigned,std::vector<query_hit> >::iterator hits_it;
-                    hits_it = hits.find(p);
-                    if (hits_it == hits.end())
-                    {
-                        std::vector<query_hit> pointHits;
-                        pointHits.reserve(1);
-                        pointHits.push_back(std::move(hit));
-                        hits.insert(std::make_pair(p, pointHits));
-                    }
-                    else
-                    {
-                        hits_it->second.push_back(std::move(hit));
-                    }
-                }
-            }
-            if (has_hit > 0)
-            {
-                idx++;
-            }
+        for (auto const& point_hit : feature_hit.second)
+        {
+            query_hit hit;
+            hit.distance = point_hit.second;
+            hit.feature_id = idx;
+            hits[point_hit.first].push_back(std::move(hit));
         }
+        ++idx;
     }
 
     // Sort each group of hits by distance.
@@ -2718,60 +2729,6 @@ NAN_METHOD(VectorTile::toJSON)
     }
 }
 
-bool layer_to_geojson(protozero::pbf_reader const& layer,
-                      std::string & result,
-                      unsigned x,
-                      unsigned y,
-                      unsigned z)
-{
-    mapnik::vector_tile_impl::tile_datasource_pbf ds(layer, x, y, z);
-    mapnik::projection wgs84("+init=epsg:4326",true);
-    mapnik::projection merc("+init=epsg:3857",true);
-    mapnik::proj_transform prj_trans(merc,wgs84);
-    // This mega box ensures we capture all features, including those
-    // outside the tile extent. Geometries outside the tile extent are
-    // likely when the vtile was created by clipping to a buffered extent
-    mapnik::query q(mapnik::box2d<double>(std::numeric_limits<double>::lowest(),
-                                          std::numeric_limits<double>::lowest(),
-                                          std::numeric_limits<double>::max(),
-                                          std::numeric_limits<double>::max()));
-    mapnik::layer_descriptor ld = ds.get_descriptor();
-    for (auto const& item : ld.get_descriptors())
-    {
-        q.add_property_name(item.get_name());
-    }
-    mapnik::featureset_ptr fs = ds.features(q);
-    bool first = true;
-    if (fs && mapnik::is_valid(fs))
-    {
-        mapnik::feature_ptr feature;
-        while ((feature = fs->next()))
-        {
-            if (first)
-            {
-                first = false;
-            }
-            else
-            {
-                result += "\n,";
-            }
-            std::string feature_str;
-            mapnik::feature_impl feature_new(feature->context(),feature->id());
-            feature_new.set_data(feature->get_data());
-            unsigned int n_err = 0;
-            feature_new.set_geometry(mapnik::geometry::reproject_copy(feature->get_geometry(), prj_trans, n_err));
-            if (!mapnik::util::to_geojson(feature_str, feature_new))
-            {
-                // LCOV_EXCL_START
-                throw std::runtime_error("Failed to generate GeoJSON geometry");
-                // LCOV_EXCL_STOP
-            }
-            result += feature_str;
-        }
-    }
-    return !first;
-}
-
 /**
  * Syncronous version of {@link VectorTile}
  *
@@ -2793,122 +2750,6 @@ NAN_METHOD(VectorTile::toGeoJSONSync)
     info.GetReturnValue().Set(_toGeoJSONSync(info));
 }
 
-void write_geojson_array(std::string & result,
-                         VectorTile * v)
-{
-    protozero::pbf_reader tile_msg = v->get_tile()->get_reader();
-    result += "[";
-    bool first = true;
-    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
-    {
-        if (first)
-        {
-            first = false;
-        }
-        else 
-        {
-            result += ",";
-        }
-        auto data_view = tile_msg.get_view();
-        protozero::pbf_reader layer_msg(data_view);
-        protozero::pbf_reader name_msg(data_view);
-        std::string layer_name;
-        if (name_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME))
-        {
-            layer_name = name_msg.get_string();
-        }
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + layer_name + "\",\"features\":[";
-        std::string features;
-        bool hit = layer_to_geojson(layer_msg,
-                                    features,
-                                    v->get_tile()->x(),
-                                    v->get_tile()->y(),
-                                    v->get_tile()->z());
-        if (hit)
-        {
-            result += features;
-        }
-        result += "]}";
-    }
-    result += "]";
-}
-
-void write_geojson_all(std::string & result,
-                       VectorTile * v)
-{
-    protozero::pbf_reader tile_msg = v->get_tile()->get_reader();
-    result += "{\"type\":\"FeatureCollection\",\"features\":[";
-    bool first = true;
-    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
-    {
-        protozero::pbf_reader layer_msg(tile_msg.get_message());
-        std::string features;
-        bool hit = layer_to_geojson(layer_msg,
-                                    features,
-                                    v->get_tile()->x(),
-                                    v->get_tile()->y(),
-                                    v->get_tile()->z());
-        if (hit)
-        {
-            if (first)
-            {
-                first = false;
-            }
-            else 
-            {
-                result += ",";
-            }
-            result += features;
-        }
-    }
-    result += "]}";
-}
-
-bool write_geojson_layer_index(std::string & result,
-                               std::size_t layer_idx,
-                               VectorTile * v)
-{
-    protozero::pbf_reader layer_msg;
-    if (v->get_tile()->layer_reader(layer_idx, layer_msg) &&
-        v->get_tile()->get_layers().size() > layer_idx)
-    {
-        std::string layer_name = v->get_tile()->get_layers()[layer_idx];
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + layer_name + "\",\"features\":[";
-        layer_to_geojson(layer_msg, 
-                         result, 
-                         v->get_tile()->x(),
-                         v->get_tile()->y(),
-                         v->get_tile()->z());
-        result += "]}";
-        return true;
-    }
-    // LCOV_EXCL_START
-    return false;
-    // LCOV_EXCL_STOP
-}
-
-bool write_geojson_layer_name(std::string & result,
-                              std::string const& name,
-                              VectorTile * v)
-{
-    protozero::pbf_reader layer_msg;
-    if (v->get_tile()->layer_reader(name, layer_msg))
-    {
-        result += "{\"type\":\"FeatureCollection\",";
-        result += "\"name\":\"" + name + "\",\"features\":[";
-        layer_to_geojson(layer_msg, 
-                         result, 
-                         v->get_tile()->x(),
-                         v->get_tile()->y(),
-                         v->get_tile()->z());
-        result += "]}";
-        return true;
-    }
-    return false;
-}
-
 v8::Local<v8::Value> VectorTile::_toGeoJSONSync(Nan::NAN_METHOD_ARGS_TYPE info)
 {
     Nan::EscapableHandleScope scope;
@@ -2925,51 +2766,58 @@ v8::Local<v8::Value> VectorTile::_toGeoJSONSync(Nan::NAN_METHOD_ARGS_TYPE info)
     }
 
     VectorTile* v = Nan::ObjectWrap::Unwrap<VectorTile>(info.Holder());
-    std::string result;
-    try
+    node_mapnik::geojson_write_type type = node_mapnik::geojson_write_all;
+    std::string layer_name;
+    int layer_idx = 0;
+    if (layer_id->IsString())
     {
-        if (layer_id->IsString())
+        layer_name = TOSTR(layer_id);
+        if (layer_name == "__array__")
         {
-            std::string layer_name = TOSTR(layer_id);
-            if (layer_name == "__array__")
-            {
-                write_geojson_array(result, v);
-            }
-            else if (layer_name == "__all__")
-            {
-                write_geojson_all(result, v);
-            }
-            else
-            {
-                if (!write_geojson_layer_name(result, layer_name, v))
-                {
-                    std::string error_msg("Layer name '" + layer_name + "' not found");
-                    Nan::ThrowTypeError(error_msg.c_str());
-                    return scope.Escape(Nan::Undefined());
-                }
-            }
+            type = node_mapnik::geojson_write_array;
         }
-        else if (layer_id->IsNumber())
+        else if (layer_name == "__all__")
         {
-            int layer_idx = layer_id->IntegerValue();
-            if (layer_idx < 0)
-            {
-                Nan::ThrowTypeError("A layer index can not be negative");
-                return scope.Escape(Nan::Undefined());
-            }
-            else if (layer_idx >= static_cast<int>(v->get_tile()->get_layers().size()))
-            {
-                Nan::ThrowTypeError("Layer index exceeds the number of layers in the vector tile.");
-                return scope.Escape(Nan::Undefined());
-            }
-            if (!write_geojson_layer_index(result, layer_idx, v))
+            type = node_mapnik::geojson_write_all;
+        }
+        else
+        {
+            if (!v->get_tile()->has_layer(layer_name))
             {
-                // LCOV_EXCL_START
-                Nan::ThrowTypeError("Layer could not be retrieved (should have not reached here)");
+                std::string error_msg("Layer name '" + layer_name + "' not found");
+                Nan::ThrowTypeError(error_msg.c_str());
                 return scope.Escape(Nan::Undefined());
-                // LCOV_EXCL_STOP
             }
+            type = node_mapnik::geojson_write_layer_name;
+        }
+    }
+    else if (layer_id->IsNumber())
+    {
+        layer_idx = layer_id->IntegerValue();
+        if (layer_idx < 0)
+        {
+            Nan::ThrowTypeError("A layer index can not be negative");
+            return scope.Escape(Nan::Undefined());
         }
+        else if (layer_idx >= static_cast<int>(v->get_tile()->get_layers().size()))
+        {
+            Nan::ThrowTypeError("Layer index exceeds the number of layers in the vector tile.");
+            return scope.Escape(Nan::Undefined());
+        }
+        type = node_mapnik::geojson_write_layer_index;
+    }
+    std::string result;
+    try
+    {
+        node_mapnik::geojson_writer writer(v->get_tile()->data(),
+                                           v->get_tile()->size(),
+                                           v->get_tile()->x(),
+                                           v->get_tile()->y(),
+                                           v->get_tile()->z(),
+                                           type,
+                                           layer_name,
+                                           layer_idx);
+        writer.write(result, std::numeric_limits<std::size_t>::max());
     }
     catch (std::exception const& ex)
     {
@@ -2981,13 +2829,60 @@ v8::Local<v8::Value> VectorTile::_toGeoJSONSync(Nan::NAN_METHOD_ARGS_TYPE info)
     return scope.Escape(Nan::New<v8::String>(result).ToLocalChecked());
 }
 
-enum geojson_write_type : std::uint8_t
+// Reads the `layer` argument of the asynchronous GeoJSON methods, throwing a
+// TypeError and returning false when it does not name a layer of the tile.
+static bool parse_geojson_layer(v8::Local<v8::Value> layer_id,
+                                VectorTile * v,
+                                node_mapnik::geojson_write_type & type,
+                                std::string & layer_name,
+                                int & layer_idx)
 {
-    geojson_write_all = 0,
-    geojson_write_array,
-    geojson_write_layer_name,
-    geojson_write_layer_index
-};
+    if (! (layer_id->IsString() || layer_id->IsNumber()) )
+    {
+        Nan::ThrowTypeError("'layer' argument must be either a layer name (string) or layer index (integer)");
+        return false;
+    }
+
+    if (layer_id->IsString())
+    {
+        std::string name = TOSTR(layer_id);
+        if (name == "__array__")
+        {
+            type = node_mapnik::geojson_write_array;
+        }
+        else if (name == "__all__")
+        {
+            type = node_mapnik::geojson_write_all;
+        }
+        else
+        {
+            if (!v->get_tile()->has_layer(name))
+            {
+                std::string error_msg("The layer does not contain the name: " + name);
+                Nan::ThrowTypeError(error_msg.c_str());
+                return false;
+            }
+            layer_name = name;
+            type = node_mapnik::geojson_write_layer_name;
+        }
+    }
+    else
+    {
+        layer_idx = layer_id->IntegerValue();
+        if (layer_idx < 0)
+        {
+            Nan::ThrowTypeError("A layer index can not be negative");
+            return false;
+        }
+        else if (layer_idx >= static_cast<int>(v->get_tile()->get_layers().size()))
+        {
+            Nan::ThrowTypeError("Layer index exceeds the number of layers in the vector tile.");
+            return false;
+        }
+        type = node_mapnik::geojson_write_layer_index;
+    }
+    return true;
+}
 
 struct to_geojson_baton
 {
@@ -2995,7 +2890,7 @@ struct to_geojson_baton
     VectorTile* v;
     bool error;
     std::string result;
-    geojson_write_type type;
+    node_mapnik::geojson_write_type type;
     int layer_idx;
     std::string layer_name;
     Nan::Persistent<v8::Function> cb;
@@ -3032,58 +2927,13 @@ NAN_METHOD(VectorTile::toGeoJSON)
     closure->v = Nan::ObjectWrap::Unwrap<VectorTile>(info.Holder());
     closure->error = false;
     closure->layer_idx = 0;
-    closure->type = geojson_write_all;
-
-    v8::Local<v8::Value> layer_id = info[0];
-    if (! (layer_id->IsString() || layer_id->IsNumber()) )
+    closure->type = node_mapnik::geojson_write_all;
+    if (!parse_geojson_layer(info[0], closure->v, closure->type, closure->layer_name, closure->layer_idx))
     {
         delete closure;
-        Nan::ThrowTypeError("'layer' argument must be either a layer name (string) or layer index (integer)");
         return;
     }
 
-    if (layer_id->IsString())
-    {
-        std::string layer_name = TOSTR(layer_id);
-        if (layer_name == "__array__")
-        {
-            closure->type = geojson_write_array;
-        }
-        else if (layer_name == "__all__")
-        {
-            closure->type = geojson_write_all;
-        }
-        else
-        {
-            if (!closure->v->get_tile()->has_layer(layer_name))
-            {
-                delete closure;
-                std::string error_msg("The layer does not contain the name: " + layer_name);
-                Nan::ThrowTypeError(error_msg.c_str());
-                return;
-            }
-            closure->layer_name = layer_name;
-            closure->type = geojson_write_layer_name;
-        }
-    }
-    else if (layer_id->IsNumber())
-    {
-        closure->layer_idx = layer_id->IntegerValue();
-        if (closure->layer_idx < 0)
-        {
-            delete closure;
-            Nan::ThrowTypeError("A layer index can not be negative");
-            return;
-        }
-        else if (closure->layer_idx >= static_cast<int>(closure->v->get_tile()->get_layers().size()))
-        {
-            delete closure;
-            Nan::ThrowTypeError("Layer index exceeds the number of layers in the vector tile.");
-            return;
-        }
-        closure->type = geojson_write_layer_index;
-    }
-
     v8::Local<v8::Value> callback = info[info.Length()-1];
     closure->cb.Reset(callback.As<v8::Function>());
     uv_queue_work(uv_default_loop(), &closure->request, to_geojson, (uv_after_work_cb)after_to_geojson);
@@ -3096,22 +2946,15 @@ void VectorTile::to_geojson(uv_work_t* req)
     to_geojson_baton *closure = static_cast<to_geojson_baton *>(req->data);
     try
     {
-        switch (closure->type)
-        {
-            default:
-            case geojson_write_all:
-                write_geojson_all(closure->result, closure->v);
-                break;
-            case geojson_write_array:
-                write_geojson_array(closure->result, closure->v);
-                break;
-            case geojson_write_layer_name:
-                write_geojson_layer_name(closure->result, closure->layer_name, closure->v);
-                break;
-            case geojson_write_layer_index:
-                write_geojson_layer_index(closure->result, closure->layer_idx, closure->v);
-                break;
-        }
+        node_mapnik::geojson_writer writer(closure->v->get_tile()->data(),
+                                           closure->v->get_tile()->size(),
+                                           closure->v->get_tile()->x(),
+                                           closure->v->get_tile()->y(),
+                                           closure->v->get_tile()->z(),
+                                           closure->type,
+                                           closure->layer_name,
+                                           closure->layer_idx);
+        writer.write(closure->result, std::numeric_limits<std::size_t>::max());
     }
     catch (std::exception const& ex)
     {
@@ -3147,6 +2990,70 @@ void VectorTile::after_to_geojson(uv_work_t* req)
     delete closure;
 }
 
+/**
+ * Get a {@link GeoJSONReader} that writes the same GeoJSON as
+ * {@link VectorTile#toGeoJSON} a chunk at a time on the threadpool, so that
+ * large tiles can be sent on without holding the whole document in memory.
+ * The reader works from a copy of the tile data taken when it is created.
+ *
+ * `vectorTile.toGeoJSONStream(layer, options)` wraps the reader in a
+ * readable stream of Buffers.
+ *
+ * @memberof VectorTile
+ * @instance
+ * @name toGeoJSONReader
+ * @param {string | number} [layer=__all__] a layer index, a layer name or
+ * one of the keywords `__array__` or `__all__`, as for {@link VectorTile#toGeoJSON}
+ * @param {Object} [options]
+ * @param {number} [options.chunk_size=65536] - size in bytes at which a chunk
+ * is handed back. Chunks end on a feature boundary so may be a little larger.
+ * @returns {mapnik.GeoJSONReader}
+ * @example
+ * vectorTile.toGeoJSONStream('__all__', {chunk_size: 16384}).pipe(response);
+ */
+NAN_METHOD(VectorTile::toGeoJSONReader)
+{
+    VectorTile* v = Nan::ObjectWrap::Unwrap<VectorTile>(info.Holder());
+    node_mapnik::geojson_write_type type = node_mapnik::geojson_write_all;
+    std::string layer_name;
+    int layer_idx = 0;
+    if (info.Length() > 0 && !parse_geojson_layer(info[0], v, type, layer_name, layer_idx))
+    {
+        return;
+    }
+
+    std::size_t chunk_size = 65536;
+    if (info.Length() > 1)
+    {
+        if (!info[1]->IsObject())
+        {
+            Nan::ThrowTypeError("optional second arg must be an options object");
+            return;
+        }
+        v8::Local<v8::Object> options = info[1]->ToObject();
+        if (options->Has(Nan::New("chunk_size").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("chunk_size").ToLocalChecked());
+            if (!param_val->IsNumber() || param_val->IntegerValue() <= 0)
+            {
+                Nan::ThrowTypeError("option 'chunk_size' must be a positive integer");
+                return;
+            }
+            chunk_size = param_val->IntegerValue();
+        }
+    }
+
+    GeoJSONReader * reader = new GeoJSONReader(std::string(v->get_tile()->data(), v->get_tile()->size()),
+                                               v->get_tile()->x(),
+                                               v->get_tile()->y(),
+                                               v->get_tile()->z(),
+                                               type,
+                                               layer_name,
+                                               layer_idx,
+                                               chunk_size);
+    info.GetReturnValue().Set(GeoJSONReader::NewInstance(reader));
+}
+
 /**
  * Add features to this tile from a GeoJSON string. GeoJSON coordinates must be in the WGS84 longitude & latitude CRS
  * as specified in the [GeoJSON Specification](https://www.rfc-editor.org/rfc/rfc7946.txt).
@@ -3308,6 +3215,7 @@ NAN_METHOD(VectorTile::addGeoJSON)
         ren.set_multi_polygon_union(multi_polygon_union);
         ren.set_fill_type(fill_type);
         ren.set_process_all_rings(process_all_rings);
+        d->reset_cache();
         ren.update_tile(*d->get_tile());
         info.GetReturnValue().Set(Nan::True());
     }
@@ -3437,6 +3345,7 @@ v8::Local<v8::Value> VectorTile::_addImageSync(Nan::NAN_METHOD_ARGS_TYPE info)
         mapnik::vector_tile_impl::processor ren(map);
         ren.set_scaling_method(scaling_method);
         ren.set_image_format(image_format);
+        d->reset_cache();
         ren.update_tile(*d->get_tile());
         info.GetReturnValue().Set(Nan::True());
     }
@@ -3621,6 +3530,7 @@ void VectorTile::EIO_AfterAddImage(uv_work_t* req)
 {
     Nan::HandleScope scope;
     vector_tile_add_image_baton_t *closure = static_cast<vector_tile_add_image_baton_t *>(req->data);
+    closure->d->reset_cache();
     if (closure->error)
     {
         v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
@@ -3687,6 +3597,7 @@ v8::Local<v8::Value> VectorTile::_addImageBufferSync(Nan::NAN_METHOD_ARGS_TYPE i
     }
     try
     {
+        d->reset_cache();
         add_image_buffer_as_tile_layer(*d->get_tile(), layer_name, node::Buffer::Data(obj), buffer_size); 
     }
     catch (std::exception const& ex)
@@ -3805,6 +3716,7 @@ void VectorTile::EIO_AfterAddImageBuffer(uv_work_t* req)
 {
     Nan::HandleScope scope;
     vector_tile_addimagebuffer_baton_t *closure = static_cast<vector_tile_addimagebuffer_baton_t *>(req->data);
+    closure->d->reset_cache();
     if (closure->error)
     {
         // LCOV_EXCL_START
@@ -3901,6 +3813,7 @@ v8::Local<v8::Value> VectorTile::_addDataSync(Nan::NAN_METHOD_ARGS_TYPE info)
     }
     try
     {
+        d->reset_cache();
         merge_from_compressed_buffer(*d->get_tile(), node::Buffer::Data(obj), buffer_size, validate, upgrade);
     }
     catch (std::exception const& ex)
@@ -4043,6 +3956,7 @@ void VectorTile::EIO_AfterAddData(uv_work_t* req)
 {
     Nan::HandleScope scope;
     vector_tile_adddata_baton_t *closure = static_cast<vector_tile_adddata_baton_t *>(req->data);
+    closure->d->reset_cache();
     if (closure->error)
     {
         v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
@@ -4137,6 +4051,7 @@ v8::Local<v8::Value> VectorTile::_setDataSync(Nan::NAN_METHOD_ARGS_TYPE info)
     }
     try
     {
+        d->reset_cache();
         d->clear();
         merge_from_compressed_buffer(*d->get_tile(), node::Buffer::Data(obj), buffer_size, validate, upgrade);
     }
@@ -4281,6 +4196,7 @@ void VectorTile::EIO_AfterSetData(uv_work_t* req)
 {
     Nan::HandleScope scope;
     vector_tile_setdata_baton_t *closure = static_cast<vector_tile_setdata_baton_t *>(req->data);
+    closure->d->reset_cache();
     if (closure->error)
     {
         v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
@@ -4306,6 +4222,11 @@ void VectorTile::EIO_AfterSetData(uv_work_t* req)
  * @name getDataSync
  * @param {Object} [options]
  * @param {string} [options.compression=none] - can also be `gzip`
+ * @param {boolean} [options.copy=true] - if `false` the returned buffer is not copied: gzip output
+ * is handed over directly and uncompressed output is a single Buffer holding the tile data that is
+ * returned again, to every caller, by later calls until the tile is modified. That Buffer is shared and
+ * must not be written to, as changes would show up in other callers' results even though the tile
+ * itself does not change
  * @param {int} [options.level=0] a number `0` (no compression) to `9` (best compression)
  * @param {string} options.strategy must be `FILTERED`, `HUFFMAN_ONLY`, `RLE`, `FIXED`, `DEFAULT`
  * @returns {Buffer} raw data
@@ -4327,6 +4248,7 @@ v8::Local<v8::Value> VectorTile::_getDataSync(Nan::NAN_METHOD_ARGS_TYPE info)
     VectorTile* d = Nan::ObjectWrap::Unwrap<VectorTile>(info.Holder());
 
     bool compress = false;
+    bool copy = true;
     int level = Z_DEFAULT_COMPRESSION;
     int strategy = Z_DEFAULT_STRATEGY;
 
@@ -4353,6 +4275,17 @@ v8::Local<v8::Value> VectorTile::_getDataSync(Nan::NAN_METHOD_ARGS_TYPE info)
             compress = std::string("gzip") == (TOSTR(param_val->ToString()));
         }
 
+        if (options->Has(Nan::New<v8::String>("copy").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("copy").ToLocalChecked());
+            if (!param_val->IsBoolean())
+            {
+                Nan::ThrowTypeError("option 'copy' must be a boolean");
+                return scope.Escape(Nan::Undefined());
+            }
+            copy = param_val->BooleanValue();
+        }
+
         if (options->Has(Nan::New<v8::String>("level").ToLocalChecked()))
         {
             v8::Local<v8::Value> param_val = options->Get(Nan::New("level").ToLocalChecked());
@@ -4426,13 +4359,26 @@ v8::Local<v8::Value> VectorTile::_getDataSync(Nan::NAN_METHOD_ARGS_TYPE info)
             }
             if (!compress)
             {
+                if (!copy)
+                {
+                    return scope.Escape(d->data_snapshot());
+                }
                 return scope.Escape(Nan::CopyBuffer((char*)d->tile_->data(),raw_size).ToLocalChecked());
             }
             else
             {
-                std::string compressed;
-                mapnik::vector_tile_impl::zlib_compress(d->tile_->data(), raw_size, compressed, true, level, strategy);
-                return scope.Escape(Nan::CopyBuffer((char*)compressed.data(),compressed.size()).ToLocalChecked());
+                std::unique_ptr<std::string> compressed(new std::string());
+                mapnik::vector_tile_impl::zlib_compress(d->tile_->data(), raw_size, *compressed, true, level, strategy);
+                if (!copy)
+                {
+                    std::size_t compressed_size = compressed->size();
+                    char * compressed_data = &(*compressed)[0];
+                    return scope.Escape(Nan::NewBuffer(compressed_data,
+                                                       compressed_size,
+                                                       node_mapnik::delete_buffer_owner<std::string>,
+                                                       compressed.release()).ToLocalChecked());
+                }
+                return scope.Escape(Nan::CopyBuffer((char*)compressed->data(),compressed->size()).ToLocalChecked());
             }
         }
     }
@@ -4456,6 +4402,7 @@ typedef struct
     bool error;
     std::string data;
     bool compress;
+    bool copy;
     int level;
     int strategy;
     std::string error_name;
@@ -4469,6 +4416,7 @@ typedef struct
  * @name getData
  * @param {Object} [options]
  * @param {string} [options.compression=none] compression type can also be `gzip`
+ * @param {boolean} [options.copy=true] - if `false` the returned buffer is not copied, see `getDataSync`
  * @param {int} [options.level=0] a number `0` (no compression) to `9` (best compression)
  * @param {string} options.strategy must be `FILTERED`, `HUFFMAN_ONLY`, `RLE`, `FIXED`, `DEFAULT`
  * @param {Function} callback
@@ -4492,6 +4440,7 @@ NAN_METHOD(VectorTile::getData)
 
     v8::Local<v8::Value> callback = info[info.Length()-1];
     bool compress = false;
+    bool copy = true;
     int level = Z_DEFAULT_COMPRESSION;
     int strategy = Z_DEFAULT_STRATEGY;
 
@@ -4518,6 +4467,17 @@ NAN_METHOD(VectorTile::getData)
             compress = std::string("gzip") == (TOSTR(param_val->ToString()));
         }
 
+        if (options->Has(Nan::New("copy").ToLocalChecked()))
+        {
+            v8::Local<v8::Value> param_val = options->Get(Nan::New("copy").ToLocalChecked());
+            if (!param_val->IsBoolean())
+            {
+                Nan::ThrowTypeError("option 'copy' must be a boolean");
+                return;
+            }
+            copy = param_val->BooleanValue();
+        }
+
         if (options->Has(Nan::New("level").ToLocalChecked()))
         {
             v8::Local<v8::Value> param_val = options->Get(Nan::New("level").ToLocalChecked());
@@ -4574,11 +4534,12 @@ NAN_METHOD(VectorTile::getData)
     closure->request.data = closure;
     closure->d = d;
     closure->compress = compress;
+    closure->copy = copy;
     closure->level = level;
     closure->strategy = strategy;
     closure->error = false;
     closure->cb.Reset(callback.As<v8::Function>());
-    uv_queue_work(uv_default_loop(), &closure->request, get_data, (uv_after_work_cb)after_get_data);
+    node_mapnik::queue_work(&closure->request, get_data, (uv_after_work_cb)after_get_data, node_mapnik::WORK_CLASS_ENCODE);
     d->Ref();
     return;
 }
@@ -4620,6 +4581,16 @@ void VectorTile::after_get_data(uv_work_t* req)
         Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
         // LCOV_EXCL_STOP
     }
+    else if (!closure->data.empty() && !closure->copy)
+    {
+        // hand the compressed bytes to the Buffer instead of copying them
+        std::string * data = new std::string(std::move(closure->data));
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), Nan::NewBuffer(&(*data)[0],
+                                                                     data->size(),
+                                                                     node_mapnik::delete_buffer_owner<std::string>,
+                                                                     data).ToLocalChecked() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
     else if (!closure->data.empty())
     {
         v8::Local<v8::Value> argv[2] = { Nan::Null(), Nan::CopyBuffer((char*)closure->data.data(),closure->data.size()).ToLocalChecked() };
@@ -4645,6 +4616,11 @@ void VectorTile::after_get_data(uv_work_t* req)
             Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
             // LCOV_EXCL_STOP
         }
+        else if (!closure->copy)
+        {
+            v8::Local<v8::Value> argv[2] = { Nan::Null(), closure->d->data_snapshot() };
+            Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+        }
         else
         {
             v8::Local<v8::Value> argv[2] = { Nan::Null(), Nan::CopyBuffer((char*)closure->d->tile_->data(),raw_size).ToLocalChecked() };
@@ -5088,7 +5064,7 @@ NAN_METHOD(VectorTile::render)
     closure->m = m;
     closure->error = false;
     closure->cb.Reset(callback.As<v8::Function>());
-    uv_queue_work(uv_default_loop(), &closure->request, EIO_RenderTile, (uv_after_work_cb)EIO_AfterRenderTile);
+    node_mapnik::queue_work(&closure->request, EIO_RenderTile, (uv_after_work_cb)EIO_AfterRenderTile, node_mapnik::WORK_CLASS_RENDER);
     m->_ref();
     d->Ref();
     guard.release();
@@ -5352,6 +5328,7 @@ v8::Local<v8::Value> VectorTile::_clearSync(Nan::NAN_METHOD_ARGS_TYPE info)
 {
     Nan::EscapableHandleScope scope;
     VectorTile* d = Nan::ObjectWrap::Unwrap<VectorTile>(info.Holder());
+    d->reset_cache();
     d->clear();
     return scope.Escape(Nan::Undefined());
 }
@@ -5426,6 +5403,7 @@ void VectorTile::EIO_AfterClear(uv_work_t* req)
 {
     Nan::HandleScope scope;
     clear_vector_tile_baton_t *closure = static_cast<clear_vector_tile_baton_t *>(req->data);
+    closure->d->reset_cache();
     if (closure->error)
     {
         // No reason this should ever throw an exception, not currently testable.
@@ -5804,9 +5782,7 @@ void layer_not_valid(protozero::pbf_reader & layer_msg,
             {
                 if (lat_lon)
                 {
-                    mapnik::projection wgs84("+init=epsg:4326",true);
-                    mapnik::projection merc("+init=epsg:3857",true);
-                    mapnik::proj_transform prj_trans(merc,wgs84);
+                    mapnik::proj_transform const& prj_trans = node_mapnik::merc_to_wgs84();
                     unsigned int n_err = 0;
                     mapnik::util::apply_visitor(
                             visitor_geom_valid(errors, feature, ds.get_name(), split_multi_features), 
@@ -6370,6 +6346,8 @@ NAN_SETTER(VectorTile::set_tile_x)
             return;
         }
         d->tile_->x(val);
+        // features are decoded relative to the tile coordinates
+        d->reset_cache();
     }
 }
 
@@ -6389,6 +6367,7 @@ NAN_SETTER(VectorTile::set_tile_y)
             return;
         }
         d->tile_->y(val);
+        d->reset_cache();
     }
 }
 
@@ -6408,6 +6387,7 @@ NAN_SETTER(VectorTile::set_tile_z)
             return;
         }
         d->tile_->z(val);
+        d->reset_cache();
     }
 }
 
@@ -11,6 +11,9 @@
 #include "vector_tile_merc_tile.hpp"
 
 // std
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <set>
 #include <vector>
@@ -21,6 +24,10 @@
 // boost
 #include <boost/version.hpp>
 
+namespace node_mapnik {
+class vector_tile_index;
+}
+
 struct query_lonlat 
 {
     double lon;
@@ -89,6 +96,7 @@ public:
     static NAN_METHOD(toGeoJSONSync);
     static void to_geojson(uv_work_t* req);
     static void after_to_geojson(uv_work_t* req);
+    static NAN_METHOD(toGeoJSONReader);
     static NAN_METHOD(addGeoJSON);
     static NAN_METHOD(addImage);
     static void EIO_AddImage(uv_work_t* req);
@@ -190,6 +198,24 @@ public:
         return tile_;
     }
     
+    // Buffer returned by `getData({copy:false})`. It holds a single copy of
+    // the tile data and is handed out again until the tile is next modified.
+    // JS can still write to it, so callers are documented not to.
+    v8::Local<v8::Object> data_snapshot();
+
+    // Spatial index used by `query` and `queryMany`, built on first use.
+    // Safe to call from worker threads.
+    std::shared_ptr<node_mapnik::vector_tile_index const> get_index();
+
+    // Must be called on the main thread whenever the tile data changes
+    void reset_cache()
+    {
+        data_snapshot_.Reset();
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        index_.reset();
+        ++index_generation_;
+    }
+
     void _ref()
     { 
         Ref(); 
@@ -202,6 +228,12 @@ public:
 
 private:
     mapnik::vector_tile_impl::merc_tile_ptr tile_;
+    Nan::Persistent<v8::Object> data_snapshot_;
+    std::shared_ptr<node_mapnik::vector_tile_index const> index_;
+    // bumped by `reset_cache` so that an index built from older tile data
+    // is not published
+    std::uint64_t index_generation_;
+    std::mutex index_mutex_;
     ~VectorTile();
 };
 
@@ -0,0 +1,696 @@
+#include "mapnik_vector_tile_geojson.hpp"
+#include "mapnik_projection.hpp"
+#include "utils.hpp"
+
+// mapnik-vector-tile
+#include "vector_tile_datasource_pbf.hpp"
+#include "vector_tile_geometry_decoder.hpp"
+#include "vector_tile_projection.hpp"
+
+// mapnik
+#include <mapnik/geometry.hpp>
+#include <mapnik/proj_transform.hpp>
+#include <mapnik/util/variant.hpp>
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace node_mapnik {
+
+namespace {
+
+struct json_property_writer
+{
+    std::string & out_;
+
+    explicit json_property_writer(std::string & out)
+        : out_(out) {}
+
+    void operator() (std::string const& val)
+    {
+        write_json_string(out_, val);
+    }
+
+    void operator() (bool const& val)
+    {
+        out_ += val ? "true" : "false";
+    }
+
+    void operator() (int64_t const& val)
+    {
+        out_ += std::to_string(val);
+    }
+
+    void operator() (uint64_t const& val)
+    {
+        // LCOV_EXCL_START
+        out_ += std::to_string(val);
+        // LCOV_EXCL_STOP
+    }
+
+    void operator() (double const& val)
+    {
+        write_json_number(out_, val);
+    }
+
+    void operator() (float const& val)
+    {
+        write_json_number(out_, val);
+    }
+};
+
+// Writes a geometry decoded in mercator as GeoJSON in WGS84, reprojecting
+// each coordinate as it is written.
+struct json_geometry_writer
+{
+    std::string & out_;
+    mapnik::proj_transform const& prj_trans_;
+
+    json_geometry_writer(std::string & out,
+                         mapnik::proj_transform const& prj_trans)
+        : out_(out),
+          prj_trans_(prj_trans) {}
+
+    void coordinates(mapnik::geometry::point<double> const& pt)
+    {
+        double x = pt.x;
+        double y = pt.y;
+        double z = 0;
+        prj_trans_.forward(x, y, z);
+        out_ += '[';
+        write_json_number(out_, x);
+        out_ += ',';
+        write_json_number(out_, y);
+        out_ += ']';
+    }
+
+    template <typename Points>
+    void coordinates(Points const& points)
+    {
+        out_ += '[';
+        bool first = true;
+        for (auto const& pt : points)
+        {
+            if (!first)
+            {
+                out_ += ',';
+            }
+            first = false;
+            coordinates(pt);
+        }
+        out_ += ']';
+    }
+
+    void coordinates(mapnik::geometry::polygon<double> const& poly)
+    {
+        out_ += '[';
+        coordinates(poly.exterior_ring);
+        for (auto const& ring : poly.interior_rings)
+        {
+            out_ += ',';
+            coordinates(ring);
+        }
+        out_ += ']';
+    }
+
+    template <typename Parts>
+    void parts(Parts const& geom)
+    {
+        out_ += '[';
+        bool first = true;
+        for (auto const& part : geom)
+        {
+            if (!first)
+            {
+                out_ += ',';
+            }
+            first = false;
+            coordinates(part);
+        }
+        out_ += ']';
+    }
+
+    void operator() (mapnik::geometry::geometry_empty const&)
+    {
+        // LCOV_EXCL_START
+        out_ += "null";
+        // LCOV_EXCL_STOP
+    }
+
+    void operator() (mapnik::geometry::point<double> const& geom)
+    {
+        out_ += "{\"type\":\"Point\",\"coordinates\":";
+        coordinates(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::line_string<double> const& geom)
+    {
+        out_ += "{\"type\":\"LineString\",\"coordinates\":";
+        coordinates(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::polygon<double> const& geom)
+    {
+        out_ += "{\"type\":\"Polygon\",\"coordinates\":";
+        coordinates(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::multi_point<double> const& geom)
+    {
+        out_ += "{\"type\":\"MultiPoint\",\"coordinates\":";
+        coordinates(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::multi_line_string<double> const& geom)
+    {
+        out_ += "{\"type\":\"MultiLineString\",\"coordinates\":";
+        parts(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::multi_polygon<double> const& geom)
+    {
+        out_ += "{\"type\":\"MultiPolygon\",\"coordinates\":";
+        parts(geom);
+        out_ += '}';
+    }
+
+    void operator() (mapnik::geometry::geometry_collection<double> const& geom)
+    {
+        // the decoder does not produce collections
+        // LCOV_EXCL_START
+        out_ += "{\"type\":\"GeometryCollection\",\"geometries\":[";
+        bool first = true;
+        for (auto const& part : geom)
+        {
+            if (!first)
+            {
+                out_ += ',';
+            }
+            first = false;
+            mapnik::util::apply_visitor(*this, part);
+        }
+        out_ += "]}";
+        // LCOV_EXCL_STOP
+    }
+};
+
+} // end anonymous ns
+
+geojson_writer::geojson_writer(char const* data,
+                               std::size_t size,
+                               unsigned x,
+                               unsigned y,
+                               unsigned z,
+                               geojson_write_type type,
+                               std::string const& layer_name,
+                               std::size_t layer_idx) :
+    tile_msg_(data, size),
+    x_(x),
+    y_(y),
+    z_(z),
+    type_(type),
+    layer_name_(layer_name),
+    layer_idx_(layer_idx),
+    layers_seen_(0),
+    stage_(stage_start),
+    first_layer_(true),
+    first_feature_(true),
+    any_feature_(false),
+    layer_msg_(),
+    keys_(),
+    values_(),
+    properties_(),
+    key_order_(),
+    version_(1),
+    tile_x_(0.0),
+    tile_y_(0.0),
+    scale_(1.0),
+    feature_id_(1) {}
+
+bool geojson_writer::open_next_layer(std::string & out)
+{
+    while (tile_msg_.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        auto data_view = tile_msg_.get_view();
+        std::size_t idx = layers_seen_++;
+        protozero::pbf_reader name_msg(data_view);
+        std::string layer_name;
+        if (name_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME))
+        {
+            layer_name = name_msg.get_string();
+        }
+        if ((type_ == geojson_write_layer_index && idx != layer_idx_) ||
+            (type_ == geojson_write_layer_name && layer_name != layer_name_))
+        {
+            continue;
+        }
+        if (type_ != geojson_write_all)
+        {
+            if (!first_layer_)
+            {
+                out += ",";
+            }
+            out += "{\"type\":\"FeatureCollection\",\"name\":";
+            write_json_string(out, layer_name);
+            out += ",\"features\":[";
+        }
+        first_layer_ = false;
+        first_feature_ = true;
+
+        // keys and values may come after the features, so read them up
+        // front and walk the features on a second pass
+        keys_.clear();
+        values_.clear();
+        version_ = 1;
+        std::uint32_t extent = 4096;
+        protozero::pbf_reader layer_msg(data_view);
+        while (layer_msg.next())
+        {
+            switch (layer_msg.tag())
+            {
+                case mapnik::vector_tile_impl::Layer_Encoding::KEYS:
+                    keys_.push_back(layer_msg.get_string());
+                    break;
+                case mapnik::vector_tile_impl::Layer_Encoding::VALUES:
+                {
+                    protozero::pbf_reader val_msg = layer_msg.get_message();
+                    while (val_msg.next())
+                    {
+                        switch(val_msg.tag())
+                        {
+                            case mapnik::vector_tile_impl::Value_Encoding::STRING:
+                                values_.push_back(val_msg.get_string());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::FLOAT:
+                                values_.push_back(val_msg.get_float());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::DOUBLE:
+                                values_.push_back(val_msg.get_double());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::INT:
+                                values_.push_back(val_msg.get_int64());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::UINT:
+                                values_.push_back(val_msg.get_uint64());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::SINT:
+                                values_.push_back(val_msg.get_sint64());
+                                break;
+                            case mapnik::vector_tile_impl::Value_Encoding::BOOL:
+                                values_.push_back(val_msg.get_bool());
+                                break;
+                            default:
+                                // LCOV_EXCL_START
+                                val_msg.skip();
+                                break;
+                                // LCOV_EXCL_STOP
+                        }
+                    }
+                    break;
+                }
+                case mapnik::vector_tile_impl::Layer_Encoding::EXTENT:
+                    extent = layer_msg.get_uint32();
+                    break;
+                case mapnik::vector_tile_impl::Layer_Encoding::VERSION:
+                    version_ = layer_msg.get_uint32();
+                    break;
+                default:
+                    layer_msg.skip();
+                    break;
+            }
+        }
+        properties_.assign(keys_.size(), -1);
+        key_order_.resize(keys_.size());
+        for (std::size_t k = 0; k < key_order_.size(); ++k)
+        {
+            key_order_[k] = k;
+        }
+        std::stable_sort(key_order_.begin(), key_order_.end(), [this](std::size_t a, std::size_t b) {
+            return keys_[a] < keys_[b];
+        });
+
+        // the same origin and scale the tile datasource decodes with
+        mapnik::vector_tile_impl::spherical_mercator merc(extent);
+        double minx, miny, maxx, maxy;
+        merc.xyz(x_, y_, z_, minx, miny, maxx, maxy);
+        tile_x_ = minx;
+        tile_y_ = maxy;
+        scale_ = static_cast<double>(extent) / (maxx - minx);
+        feature_id_ = 1;
+        layer_msg_ = protozero::pbf_reader(data_view);
+        return true;
+    }
+    return false;
+}
+
+bool geojson_writer::write_feature(protozero::pbf_reader feature_msg, std::string & out)
+{
+    std::uint64_t id = feature_id_++;
+    mapnik::vector_tile_impl::GeometryPBF::pbf_itr geom_itr;
+    mapnik::vector_tile_impl::GeometryPBF::pbf_itr tag_itr;
+    bool has_geom = false;
+    bool has_geom_type = false;
+    bool has_tags = false;
+    bool has_raster = false;
+    std::int32_t geom_type_enum = 0;
+    while (feature_msg.next())
+    {
+        switch (feature_msg.tag())
+        {
+            case mapnik::vector_tile_impl::Feature_Encoding::ID:
+                id = feature_msg.get_uint64();
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::TAGS:
+                tag_itr = feature_msg.get_packed_uint32();
+                has_tags = true;
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::TYPE:
+                geom_type_enum = feature_msg.get_enum();
+                has_geom_type = true;
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY:
+                geom_itr = feature_msg.get_packed_uint32();
+                has_geom = true;
+                break;
+            case mapnik::vector_tile_impl::Feature_Encoding::RASTER:
+                feature_msg.skip();
+                has_raster = true;
+                break;
+            default:
+                // LCOV_EXCL_START
+                feature_msg.skip();
+                break;
+                // LCOV_EXCL_STOP
+        }
+    }
+
+    mapnik::geometry::geometry<double> geom;
+    if (has_geom && has_geom_type)
+    {
+        mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
+        geom = mapnik::vector_tile_impl::decode_geometry<double>(geoms, geom_type_enum, version_,
+                                                                 tile_x_, tile_y_, scale_, -1.0 * scale_);
+    }
+    if (geom.is<mapnik::geometry::geometry_empty>() && !has_raster)
+    {
+        // nothing to write, the tile datasource skips these as well
+        return false;
+    }
+
+    if (first_feature_)
+    {
+        first_feature_ = false;
+        if (type_ == geojson_write_all && any_feature_)
+        {
+            out += ",";
+        }
+    }
+    else
+    {
+        out += "\n,";
+    }
+    any_feature_ = true;
+
+    out += "{\"type\":\"Feature\",\"id\":";
+    out += std::to_string(static_cast<std::int64_t>(id));
+    out += ",\"geometry\":";
+    json_geometry_writer geom_writer(out, merc_to_wgs84());
+    mapnik::util::apply_visitor(geom_writer, geom);
+    out += ",\"properties\":{";
+    if (has_tags)
+    {
+        for (auto _i = tag_itr.begin(); _i != tag_itr.end();)
+        {
+            std::size_t key_name = *(_i++);
+            if (_i == tag_itr.end())
+            {
+                break;
+            }
+            std::size_t key_value = *(_i++);
+            if (key_name < keys_.size() &&
+                key_value < values_.size())
+            {
+                properties_[key_name] = static_cast<std::int64_t>(key_value);
+            }
+        }
+        // written in key order, as the attributes of a mapnik feature are
+        // iterated through its context
+        bool first = true;
+        json_property_writer prop_writer(out);
+        for (std::size_t k : key_order_)
+        {
+            if (properties_[k] < 0)
+            {
+                continue;
+            }
+            if (!first)
+            {
+                out += ',';
+            }
+            first = false;
+            write_json_string(out, keys_[k]);
+            out += ':';
+            mapnik::util::apply_visitor(prop_writer, values_[properties_[k]]);
+            properties_[k] = -1;
+        }
+    }
+    out += "}}";
+    return true;
+}
+
+bool geojson_writer::write(std::string & out, std::size_t chunk_size)
+{
+    while (stage_ != stage_done && out.size() < chunk_size)
+    {
+        switch (stage_)
+        {
+            case stage_start:
+                if (type_ == geojson_write_all)
+                {
+                    out += "{\"type\":\"FeatureCollection\",\"features\":[";
+                }
+                else if (type_ == geojson_write_array)
+                {
+                    out += "[";
+                }
+                stage_ = stage_layer;
+                break;
+            case stage_layer:
+                stage_ = open_next_layer(out) ? stage_features : stage_finish;
+                break;
+            case stage_features:
+                if (layer_msg_.next(mapnik::vector_tile_impl::Layer_Encoding::FEATURES))
+                {
+                    write_feature(layer_msg_.get_message(), out);
+                }
+                else
+                {
+                    if (type_ != geojson_write_all)
+                    {
+                        out += "]}";
+                    }
+                    bool single = type_ == geojson_write_layer_name || type_ == geojson_write_layer_index;
+                    stage_ = single ? stage_finish : stage_layer;
+                }
+                break;
+            case stage_finish:
+                if (type_ == geojson_write_all)
+                {
+                    out += "]}";
+                }
+                else if (type_ == geojson_write_array)
+                {
+                    out += "]";
+                }
+                stage_ = stage_done;
+                break;
+            default:
+                break;
+        }
+    }
+    return stage_ == stage_done;
+}
+
+} // end ns
+
+Nan::Persistent<v8::FunctionTemplate> GeoJSONReader::constructor;
+
+/**
+ * **`mapnik.GeoJSONReader`**
+ *
+ * Reads the GeoJSON of a {@link VectorTile} in chunks, created by
+ * {@link VectorTile#toGeoJSONReader}. Each chunk is written on the
+ * threadpool so only one chunk at a time is held in memory.
+ *
+ * @class GeoJSONReader
+ */
+void GeoJSONReader::Initialize(v8::Local<v8::Object> target) {
+
+    Nan::HandleScope scope;
+
+    v8::Local<v8::FunctionTemplate> lcons = Nan::New<v8::FunctionTemplate>(GeoJSONReader::New);
+    lcons->InstanceTemplate()->SetInternalFieldCount(1);
+    lcons->SetClassName(Nan::New("GeoJSONReader").ToLocalChecked());
+
+    Nan::SetPrototypeMethod(lcons, "read", read);
+
+    target->Set(Nan::New("GeoJSONReader").ToLocalChecked(), lcons->GetFunction());
+    constructor.Reset(lcons);
+}
+
+GeoJSONReader::GeoJSONReader(std::string const& data,
+                             unsigned x,
+                             unsigned y,
+                             unsigned z,
+                             node_mapnik::geojson_write_type type,
+                             std::string const& layer_name,
+                             std::size_t layer_idx,
+                             std::size_t chunk_size) :
+    Nan::ObjectWrap(),
+    data_(data),
+    writer_(data_.data(), data_.size(), x, y, z, type, layer_name, layer_idx),
+    chunk_size_(chunk_size),
+    reading_(false) {}
+
+GeoJSONReader::~GeoJSONReader()
+{
+}
+
+NAN_METHOD(GeoJSONReader::New)
+{
+    if (!info.IsConstructCall())
+    {
+        Nan::ThrowError("Cannot call constructor as function, you need to use 'new' keyword");
+        return;
+    }
+
+    if (info[0]->IsExternal())
+    {
+        v8::Local<v8::External> ext = info[0].As<v8::External>();
+        void* ptr = ext->Value();
+        GeoJSONReader* r = static_cast<GeoJSONReader*>(ptr);
+        r->Wrap(info.This());
+        info.GetReturnValue().Set(info.This());
+        return;
+    }
+
+    Nan::ThrowTypeError("Sorry a GeoJSONReader cannot be created directly, use VectorTile.toGeoJSONReader");
+    return;
+}
+
+v8::Local<v8::Value> GeoJSONReader::NewInstance(GeoJSONReader * reader)
+{
+    Nan::EscapableHandleScope scope;
+    v8::Local<v8::Value> ext = Nan::New<v8::External>(reader);
+    return scope.Escape(Nan::New(constructor)->GetFunction()->NewInstance(1, &ext));
+}
+
+struct geojson_read_baton
+{
+    uv_work_t request;
+    GeoJSONReader* r;
+    std::string chunk;
+    bool done;
+    bool error;
+    std::string error_name;
+    Nan::Persistent<v8::Function> cb;
+};
+
+/**
+ * Write the next chunk of GeoJSON. Concatenating the chunks in order gives
+ * the same document as {@link VectorTile#toGeoJSON}. Once the document is
+ * complete the callback gets `null`.
+ *
+ * @name read
+ * @instance
+ * @memberof GeoJSONReader
+ * @param {Function} callback - `function(err, chunk)` where `chunk` is a
+ * Buffer or `null` at the end of the document
+ * @example
+ * var reader = vectorTile.toGeoJSONReader('__all__');
+ * reader.read(function next(err, chunk) {
+ *   if (err) throw err;
+ *   if (chunk === null) return;
+ *   response.write(chunk);
+ *   reader.read(next);
+ * });
+ */
+NAN_METHOD(GeoJSONReader::read)
+{
+    if (info.Length() < 1 || !info[info.Length()-1]->IsFunction())
+    {
+        Nan::ThrowTypeError("last argument must be a callback function");
+        return;
+    }
+    GeoJSONReader* r = Nan::ObjectWrap::Unwrap<GeoJSONReader>(info.Holder());
+    if (r->reading_)
+    {
+        Nan::ThrowError("a read is already in progress");
+        return;
+    }
+    geojson_read_baton *closure = new geojson_read_baton();
+    closure->request.data = closure;
+    closure->r = r;
+    closure->done = false;
+    closure->error = false;
+    closure->cb.Reset(info[info.Length()-1].As<v8::Function>());
+    r->reading_ = true;
+    uv_queue_work(uv_default_loop(), &closure->request, EIO_Read, (uv_after_work_cb)EIO_AfterRead);
+    r->Ref();
+    return;
+}
+
+void GeoJSONReader::EIO_Read(uv_work_t* req)
+{
+    geojson_read_baton *closure = static_cast<geojson_read_baton *>(req->data);
+    try
+    {
+        closure->done = closure->r->writer_.write(closure->chunk, closure->r->chunk_size_);
+    }
+    catch (std::exception const& ex)
+    {
+        // LCOV_EXCL_START
+        closure->error = true;
+        closure->error_name = ex.what();
+        // LCOV_EXCL_STOP
+    }
+}
+
+void GeoJSONReader::EIO_AfterRead(uv_work_t* req)
+{
+    Nan::HandleScope scope;
+    geojson_read_baton *closure = static_cast<geojson_read_baton *>(req->data);
+    closure->r->reading_ = false;
+    if (closure->error)
+    {
+        // LCOV_EXCL_START
+        v8::Local<v8::Value> argv[1] = { Nan::Error(closure->error_name.c_str()) };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 1, argv);
+        // LCOV_EXCL_STOP
+    }
+    else if (closure->chunk.empty() && closure->done)
+    {
+        v8::Local<v8::Value> argv[2] = { Nan::Null(), Nan::Null() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+    else
+    {
+        std::string * chunk = new std::string(std::move(closure->chunk));
+        v8::Local<v8::Value> argv[2] = { Nan::Null(),
+                                         Nan::NewBuffer(&(*chunk)[0],
+                                                        chunk->size(),
+                                                        node_mapnik::delete_buffer_owner<std::string>,
+                                                        chunk).ToLocalChecked() };
+        Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(closure->cb), 2, argv);
+    }
+    closure->r->Unref();
+    closure->cb.Reset();
+    delete closure;
+}
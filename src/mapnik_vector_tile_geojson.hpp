@@ -0,0 +1,121 @@
+#ifndef __NODE_MAPNIK_VECTOR_TILE_GEOJSON_H__
+#define __NODE_MAPNIK_VECTOR_TILE_GEOJSON_H__
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wshadow"
+#include <nan.h>
+#pragma GCC diagnostic pop
+
+// mapnik-vector-tile
+#include "vector_tile_datasource_pbf.hpp"
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+
+// stl
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace node_mapnik {
+
+enum geojson_write_type : std::uint8_t
+{
+    geojson_write_all = 0,
+    geojson_write_array,
+    geojson_write_layer_name,
+    geojson_write_layer_index
+};
+
+// Writes the GeoJSON of a vector tile a piece at a time so that the whole
+// document never has to be held in memory. Features are encoded straight
+// from the layer messages, without building mapnik features first. The tile
+// data passed in has to outlive the writer.
+class geojson_writer
+{
+public:
+    geojson_writer(char const* data,
+                   std::size_t size,
+                   unsigned x,
+                   unsigned y,
+                   unsigned z,
+                   geojson_write_type type,
+                   std::string const& layer_name,
+                   std::size_t layer_idx);
+
+    // Appends to `out` until it holds at least `chunk_size` bytes or the
+    // document is complete. Returns true once the document is complete.
+    bool write(std::string & out, std::size_t chunk_size);
+
+private:
+    enum write_stage : std::uint8_t
+    {
+        stage_start = 0,
+        stage_layer,
+        stage_features,
+        stage_finish,
+        stage_done
+    };
+
+    bool open_next_layer(std::string & out);
+    bool write_feature(protozero::pbf_reader feature_msg, std::string & out);
+
+    protozero::pbf_reader tile_msg_;
+    unsigned x_;
+    unsigned y_;
+    unsigned z_;
+    geojson_write_type type_;
+    std::string layer_name_;
+    std::size_t layer_idx_;
+    std::size_t layers_seen_;
+    write_stage stage_;
+    bool first_layer_;
+    bool first_feature_;
+    bool any_feature_;
+    // state of the layer being written
+    protozero::pbf_reader layer_msg_;
+    std::vector<std::string> keys_;
+    mapnik::vector_tile_impl::layer_pbf_attr_type values_;
+    // for each key, the value of the current feature or -1
+    std::vector<std::int64_t> properties_;
+    // indexes into `keys_`, sorted by key
+    std::vector<std::size_t> key_order_;
+    std::uint32_t version_;
+    double tile_x_;
+    double tile_y_;
+    double scale_;
+    std::uint64_t feature_id_;
+};
+
+} // end ns
+
+class GeoJSONReader: public Nan::ObjectWrap {
+public:
+    static Nan::Persistent<v8::FunctionTemplate> constructor;
+    static void Initialize(v8::Local<v8::Object> target);
+    static NAN_METHOD(New);
+    static v8::Local<v8::Value> NewInstance(GeoJSONReader * reader);
+    static NAN_METHOD(read);
+    static void EIO_Read(uv_work_t* req);
+    static void EIO_AfterRead(uv_work_t* req);
+
+    GeoJSONReader(std::string const& data,
+                  unsigned x,
+                  unsigned y,
+                  unsigned z,
+                  node_mapnik::geojson_write_type type,
+                  std::string const& layer_name,
+                  std::size_t layer_idx,
+                  std::size_t chunk_size);
+
+private:
+    ~GeoJSONReader();
+    // a snapshot of the tile, the writer points into it
+    std::string data_;
+    node_mapnik::geojson_writer writer_;
+    std::size_t chunk_size_;
+    bool reading_;
+};
+
+#endif // __NODE_MAPNIK_VECTOR_TILE_GEOJSON_H__
@@ -0,0 +1,95 @@
+#include "mapnik_vector_tile_index.hpp"
+
+// mapnik-vector-tile
+#include "vector_tile_datasource_pbf.hpp"
+
+// mapnik
+#include <mapnik/featureset.hpp>
+#include <mapnik/query.hpp>
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+
+// stl
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+namespace node_mapnik {
+
+std::vector<std::size_t> indexed_layer::query(mapnik::box2d<double> const& box) const
+{
+    std::vector<value_type> hits;
+    box_type b(point_type(box.minx(), box.miny()), point_type(box.maxx(), box.maxy()));
+    tree.query(boost::geometry::index::intersects(b), std::back_inserter(hits));
+    std::vector<std::size_t> positions;
+    positions.reserve(hits.size());
+    for (value_type const& hit : hits)
+    {
+        positions.push_back(hit.second);
+    }
+    std::sort(positions.begin(), positions.end());
+    return positions;
+}
+
+vector_tile_index::vector_tile_index(mapnik::vector_tile_impl::merc_tile & tile) :
+    layers_()
+{
+    double max = std::numeric_limits<double>::max();
+    mapnik::box2d<double> everything(-max, -max, max, max);
+    protozero::pbf_reader item(tile.get_reader());
+    while (item.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        protozero::pbf_reader layer_msg = item.get_message();
+        auto ds = std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
+                                        layer_msg,
+                                        tile.x(),
+                                        tile.y(),
+                                        tile.z());
+        layers_.emplace_back();
+        indexed_layer & layer = layers_.back();
+        layer.name = ds->get_name();
+
+        mapnik::query q(everything);
+        for (auto const& field : ds->get_descriptor().get_descriptors())
+        {
+            q.add_property_name(field.get_name());
+        }
+        std::vector<indexed_layer::value_type> entries;
+        mapnik::featureset_ptr fs = ds->features(q);
+        if (fs && mapnik::is_valid(fs))
+        {
+            mapnik::feature_ptr feature;
+            while ((feature = fs->next()))
+            {
+                mapnik::box2d<double> env = feature->envelope();
+                if (!env.valid())
+                {
+                    // nothing to hit, eg. raster features
+                    continue;
+                }
+                entries.emplace_back(indexed_layer::box_type(indexed_layer::point_type(env.minx(), env.miny()),
+                                                             indexed_layer::point_type(env.maxx(), env.maxy())),
+                                     layer.features.size());
+                layer.features.push_back(feature);
+            }
+        }
+        // packing constructor, bulk loads the tree
+        layer.tree = indexed_layer::rtree_type(entries);
+    }
+}
+
+indexed_layer const* vector_tile_index::find(std::string const& name) const
+{
+    for (indexed_layer const& layer : layers_)
+    {
+        if (layer.name == name)
+        {
+            return &layer;
+        }
+    }
+    return nullptr;
+}
+
+} // end ns
@@ -0,0 +1,64 @@
+#ifndef __NODE_MAPNIK_VECTOR_TILE_INDEX_H__
+#define __NODE_MAPNIK_VECTOR_TILE_INDEX_H__
+
+// mapnik-vector-tile
+#include "vector_tile_merc_tile.hpp"
+
+// mapnik
+#include <mapnik/box2d.hpp>
+#include <mapnik/feature.hpp>
+
+// boost
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+// stl
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace node_mapnik {
+
+// The decoded features of one layer of a vector tile and an R-tree over their
+// envelopes in mercator coordinates.
+struct indexed_layer
+{
+    using point_type = boost::geometry::model::d2::point_xy<double>;
+    using box_type = boost::geometry::model::box<point_type>;
+    using value_type = std::pair<box_type, std::size_t>;
+    using rtree_type = boost::geometry::index::rtree<value_type, boost::geometry::index::quadratic<16> >;
+
+    std::string name;
+    std::vector<mapnik::feature_ptr> features;
+    rtree_type tree;
+
+    // Positions in `features` of the features whose envelope intersects
+    // `box`, in the order they appear in the layer.
+    std::vector<std::size_t> query(mapnik::box2d<double> const& box) const;
+};
+
+// Spatial index of every layer of a vector tile, with all attributes of each
+// feature decoded. It is built from a snapshot of the tile data and has to be
+// thrown away when the tile changes.
+class vector_tile_index
+{
+public:
+    explicit vector_tile_index(mapnik::vector_tile_impl::merc_tile & tile);
+
+    // layers in the order they appear in the tile
+    std::vector<indexed_layer> const& layers() const
+    {
+        return layers_;
+    }
+
+    // the first layer called `name`, or nullptr
+    indexed_layer const* find(std::string const& name) const;
+
+private:
+    std::vector<indexed_layer> layers_;
+};
+
+} // end ns
+
+#endif // __NODE_MAPNIK_VECTOR_TILE_INDEX_H__
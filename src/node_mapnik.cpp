@@ -3,7 +3,9 @@
 
 // node-mapnik
 #include "mapnik_vector_tile.hpp"
+#include "mapnik_vector_tile_geojson.hpp"
 #include "mapnik_map.hpp"
+#include "mapnik_map_pool.hpp"
 #include "mapnik_color.hpp"
 #include "mapnik_geometry.hpp"
 #include "mapnik_logger.hpp"
@@ -24,6 +26,9 @@
 #include "mapnik_grid_view.hpp"
 #endif
 #include "mapnik_expression.hpp"
+#include "mapnik_thread_pool.hpp"
+#include "mapnik_encode_cache.hpp"
+#include "mapnik_stylesheet_cache.hpp"
 #include "utils.hpp"
 #include "blend.hpp"
 
@@ -136,10 +141,18 @@ extern "C" {
         Nan::SetMethod(target, "fontFiles", node_mapnik::available_font_files);
         Nan::SetMethod(target, "memoryFonts", node_mapnik::memory_fonts);
         Nan::SetMethod(target, "clearCache", clearCache);
+        Nan::SetMethod(target, "setThreadPool", node_mapnik::setThreadPool);
+        Nan::SetMethod(target, "setEncodeCache", node_mapnik::setEncodeCache);
+        Nan::SetMethod(target, "encodeCacheStats", node_mapnik::encodeCacheStats);
+        Nan::SetMethod(target, "setStylesheetCache", node_mapnik::setStylesheetCache);
+        Nan::SetMethod(target, "clearStylesheetCache", node_mapnik::clearStylesheetCache);
+        Nan::SetMethod(target, "stylesheetCacheStats", node_mapnik::stylesheetCacheStats);
 
         // Classes
         VectorTile::Initialize(target);
+        GeoJSONReader::Initialize(target);
         Map::Initialize(target);
+        MapPool::Initialize(target);
         Color::Initialize(target);
         Geometry::Initialize(target);
         Feature::Initialize(target);
@@ -8,8 +8,12 @@
 #pragma GCC diagnostic pop
 
 // stl
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <memory>
+#include <streambuf>
 
 // core types
 #include <mapnik/unicode.hpp>
@@ -81,6 +85,98 @@ struct value_converter
     }
 };
 
+// Free callback for `Nan::NewBuffer` when the Buffer memory is owned by a
+// heap allocated `T` passed as the hint.
+template <typename T>
+void delete_buffer_owner(char *, void * hint)
+{
+    delete static_cast<T *>(hint);
+}
+
+// A stream buffer appending everything written to it to a std::string.
+// Encoders write through it into memory that can then be handed to a
+// Buffer with `delete_buffer_owner<std::string>`, instead of the copy
+// `std::ostringstream::str()` makes.
+class string_streambuf : public std::streambuf
+{
+public:
+    explicit string_streambuf(std::string & out)
+        : out_(out) {}
+
+protected:
+    std::streamsize xsputn(char const* s, std::streamsize n) override
+    {
+        out_.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+    int_type overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            out_.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::string & out_;
+};
+
+// Appends `str` as a quoted and escaped JSON string.
+inline void write_json_string(std::string & out, std::string const& str)
+{
+    out += '"';
+    for (char c : str)
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out += buf;
+                }
+                else
+                {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Appends `val` as a JSON number, or null when it is not finite. Uses the
+// fewest of 15 to 17 significant digits that read back as the same double.
+inline void write_json_number(std::string & out, double val)
+{
+    if (!std::isfinite(val))
+    {
+        // LCOV_EXCL_START
+        out += "null";
+        return;
+        // LCOV_EXCL_STOP
+    }
+    char buf[32];
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        int len = std::snprintf(buf, sizeof(buf), "%.*g", precision, val);
+        if (precision == 17 || std::strtod(buf, nullptr) == val)
+        {
+            out.append(buf, len);
+            return;
+        }
+    }
+}
+
 inline void params_to_object(v8::Local<v8::Object>& ds, std::string const& key, mapnik::value_holder const& val)
 {
     ds->Set(Nan::New<v8::String>(key.c_str()).ToLocalChecked(), mapnik::util::apply_visitor(value_converter(), val));
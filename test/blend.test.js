@@ -51,6 +51,8 @@ describe('mapnik.blend', function() {
         assert.throws(function() { mapnik.blend(images, {compression:'foo'}, function(err, result) {}); });
         assert.throws(function() { mapnik.blend(images, {width:-1}, function(err, result) {}); });
         assert.throws(function() { mapnik.blend(images, {height:-1}, function(err, result) {}); });
+        assert.throws(function() { mapnik.blend(images, {threads:-1}, function(err, result) {}); });
+        assert.throws(function() { mapnik.blend(images, {threads:'foo'}, function(err, result) {}); });
     });
 
     it('blended png', function(done) {
@@ -214,6 +216,85 @@ describe('mapnik.blend', function() {
         });
     });
 
+    it('blended png - objects - tinting matches per pixel tinting', function(done) {
+        // Same math as TintPixel and the alpha mapping in src/blend.cpp,
+        // applied to every pixel without the lookup tables.
+        function hueToRGB(m1, m2, h) {
+            if (h < 0) h += 1;
+            if (h > 1) h -= 1;
+            if (h * 6 < 1) return m1 + (m2 - m1) * h * 6;
+            if (h * 2 < 1) return m2;
+            if (h * 3 < 2) return m1 + (m2 - m1) * (0.66666 - h) * 6;
+            return m1;
+        }
+        function clamp(v) { return v > 1 ? 1 : (v < 0 ? 0 : v); }
+        function tintPixel(rgba, i, tint) {
+            var a = rgba[i + 3];
+            var a2 = tint.a[0] + (a / 255.0 * (tint.a[1] - tint.a[0]));
+            if (a2 < 0) a2 = 0;
+            a = Math.min(255, Math.floor((a2 * 255.0) + 0.5));
+            rgba[i + 3] = a;
+            if (a <= 1) return;
+            var r = rgba[i] / 255.0, g = rgba[i + 1] / 255.0, b = rgba[i + 2] / 255.0;
+            var max = Math.max(r, Math.max(g, b));
+            var min = Math.min(r, Math.min(g, b));
+            var delta = max - min;
+            var gamma = max + min;
+            var h = 0.0, s = 0.0, l = gamma / 2.0;
+            if (delta > 0.0) {
+                s = l > 0.5 ? delta / (2.0 - gamma) : delta / gamma;
+                if (r >= b && r > g) h = (g - b) / delta + (g < b ? 6.0 : 0.0);
+                if (g >= r && g > b) h = (b - r) / delta + 2.0;
+                if (b >= g && b > r) h = (r - g) / delta + 4.0;
+                h /= 6.0;
+            }
+            h = clamp(tint.h[0] + (h * (tint.h[1] - tint.h[0])));
+            s = clamp(tint.s[0] + (s * (tint.s[1] - tint.s[0])));
+            l = clamp(tint.l[0] + (l * (tint.l[1] - tint.l[0])));
+            if (!s) {
+                rgba[i] = rgba[i + 1] = rgba[i + 2] = Math.floor((l * 255.0) + 0.5);
+            } else {
+                var m2 = (l <= 0.5) ? l * (s + 1) : l + s - l * s;
+                var m1 = l * 2.0 - m2;
+                rgba[i] = Math.floor(hueToRGB(m1, m2, h + 0.33333) * 255.0);
+                rgba[i + 1] = Math.floor(hueToRGB(m1, m2, h) * 255.0);
+                rgba[i + 2] = Math.floor(hueToRGB(m1, m2, h - 0.33333) * 255.0);
+            }
+        }
+
+        // more distinct colors than the tinted color cache has slots, with
+        // the lower half repeating the upper half so that cached colors are
+        // reused as well as evicted
+        var width = 128, height = 256;
+        var source = new Buffer(width * height * 4);
+        var half = source.length / 2;
+        for (var i = 0; i < half; i += 4) {
+            var p = i / 4;
+            source[i] = source[half + i] = (p * 7) & 0xff;
+            source[i + 1] = source[half + i + 1] = (p * 13 + (p >> 8)) & 0xff;
+            source[i + 2] = source[half + i + 2] = (p * 29 + (p >> 6)) & 0xff;
+            source[i + 3] = source[half + i + 3] = 255 - (p % 5) * 50;
+        }
+        var tint = { h: [0.1, 0.9], s: [0.2, 0.7], l: [0.1, 0.9], a: [0.1, 0.9] };
+        var tinted = new Buffer(source);
+        for (var j = 0; j < tinted.length; j += 4) {
+            tintPixel(tinted, j, tint);
+        }
+        var source_png = new mapnik.Image.fromBufferSync(width, height, source).encodeSync('png32');
+        var tinted_png = new mapnik.Image.fromBufferSync(width, height, tinted).encodeSync('png32');
+        var options = {width: width, height: height, reencode: true};
+        mapnik.blend([{ buffer: source_png, tint: tint }], options, function(err, actual) {
+            if (err) throw err;
+            mapnik.blend([tinted_png], options, function(err, expected) {
+                if (err) throw err;
+                var actual_data = new mapnik.Image.fromBytesSync(actual).data();
+                var expected_data = new mapnik.Image.fromBytesSync(expected).data();
+                assert.ok(actual_data.equals(expected_data));
+                done();
+            });
+        });
+    });
+
     it('blended png - objects - tinting - fails h', function() {
         var input = [{
                 buffer: fs.readFileSync('test/blend-fixtures/1a.png'),
@@ -442,6 +523,114 @@ describe('mapnik.blend', function() {
         });
     });
 
+    it('blended png matches the reference compositing exactly', function(done) {
+        // deterministic pixels mixing transparent, opaque and partial alpha
+        var seed = 1;
+        var random = function() {
+            seed = (seed * 1103515245 + 12345) % 2147483648;
+            return seed >>> 16;
+        };
+        var pixels = function(width, height) {
+            var buffer = new Buffer(width * height * 4);
+            for (var i = 0; i < buffer.length; i += 4) {
+                buffer[i] = random() & 0xff;
+                buffer[i + 1] = random() & 0xff;
+                buffer[i + 2] = random() & 0xff;
+                var kind = random() % 4;
+                buffer[i + 3] = kind === 0 ? 0 : kind === 1 ? 255 : random() & 0xff;
+            }
+            return buffer;
+        };
+        // scalar source-over on non-premultiplied pixels, as done natively
+        var composite = function(target, t, source, s) {
+            var a1 = source[s + 3];
+            var a0 = target[t + 3];
+            if (a1 === 0) return;
+            if (a1 === 255 || a0 === 0) {
+                source.copy(target, t, s, s + 4);
+                return;
+            }
+            var a = ((a1 + a0) << 8) - a0 * a1;
+            for (var c = 0; c < 3; ++c) {
+                var c0 = target[t + c] * a0;
+                target[t + c] = Math.floor((((source[s + c] << 8) - c0) * a1 + (c0 << 8)) / a);
+            }
+            target[t + 3] = a >> 8;
+        };
+        var width = 37, height = 19;
+        var bottom = pixels(width, height);
+        var top = pixels(30, 15);
+        var expected = new Buffer(width * height * 4);
+        expected.fill(0);
+        var x, y;
+        for (y = 0; y < height; ++y) {
+            for (x = 0; x < width; ++x) {
+                composite(expected, (y * width + x) * 4, bottom, (y * width + x) * 4);
+            }
+        }
+        for (y = 0; y < 15; ++y) {
+            for (x = 0; x < 30; ++x) {
+                composite(expected, ((y + 3) * width + x + 5) * 4, top, (y * 30 + x) * 4);
+            }
+        }
+        mapnik.blend([
+            mapnik.Image.fromBufferSync(width, height, bottom).encodeSync('png'),
+            { buffer: mapnik.Image.fromBufferSync(30, 15, top).encodeSync('png'), x: 5, y: 3 }
+        ], {width: width, height: height}, function(err, result) {
+            if (err) throw err;
+            var actual = new mapnik.Image.fromBytesSync(result);
+            assert.equal(actual.width(), width);
+            assert.equal(actual.height(), height);
+            assert.ok(actual.data().equals(expected));
+            done();
+        });
+    });
+
+    it('blended png - threads', function(done) {
+        var input = [
+            { buffer: images_alpha[0], x: -20, y: 30 },
+            { buffer: images_alpha[1], x: 200, y: 150, tint: { h: [0.2, 0.8] } },
+            { buffer: images_alpha[0], x: 350, y: 400 },
+            { buffer: images_alpha[1], x: 10, y: 500 }
+        ];
+        var options = {width: 600, height: 700, reencode: true};
+        mapnik.blend(input, options, function(err, expected) {
+            if (err) throw err;
+            options.threads = 4;
+            mapnik.blend(input, options, function(err, actual) {
+                if (err) throw err;
+                assert.ok(actual.equals(expected));
+                done();
+            });
+        });
+    });
+
+    it('blended png - offset layer matches a cropped layer', function(done) {
+        var cropped = new mapnik.Image.fromBytesSync(images_alpha[1]).view(100, 50, 64, 48).encodeSync('png');
+        var options = {width: 64, height: 48, reencode: true};
+        mapnik.blend([{ buffer: images_alpha[1], x: -100, y: -50 }], options, function(err, actual) {
+            if (err) throw err;
+            mapnik.blend([cropped], options, function(err, expected) {
+                if (err) throw err;
+                assert.ok(new mapnik.Image.fromBytesSync(actual).data().equals(new mapnik.Image.fromBytesSync(expected).data()));
+                done();
+            });
+        });
+    });
+
+    it('blended png - opaque top layer is returned as is', function(done) {
+        var bottom = new mapnik.Image(64, 64);
+        bottom.fill(new mapnik.Color('blue'));
+        var top = new mapnik.Image(64, 64);
+        top.fill(new mapnik.Color('green'));
+        var top_buffer = top.encodeSync('jpeg');
+        mapnik.blend([bottom.encodeSync('png'), top_buffer], function(err, result) {
+            if (err) throw err;
+            assert.strictEqual(result, top_buffer);
+            done();
+        });
+    });
+
     it('hsl to rgb works properly', function() {
         // Assert throws on bad parameters
         assert.throws(function() { mapnik.hsl2rgb(); });
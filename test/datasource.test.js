@@ -29,6 +29,40 @@ describe('mapnik.Datasource', function() {
             /Shape Plugin: missing <file> parameter/);
     });
 
+    it('should create a datasource and query it asynchronously', function(done) {
+        assert.throws(function() { mapnik.Datasource.create(); });
+        assert.throws(function() { mapnik.Datasource.create('foo', function() {}); });
+        assert.throws(function() { mapnik.Datasource.create({type: 'shape'}); });
+        mapnik.Datasource.create({type: 'shape'}, function(err, ds) {
+            assert.ok(err);
+            assert.ok(/missing <file> parameter/.test(err.message));
+            var options = {
+                type: 'shape',
+                file: './test/data/world_merc.shp'
+            };
+            mapnik.Datasource.create(options, function(err, ds) {
+                assert.ifError(err);
+                assert.ok(ds instanceof mapnik.Datasource);
+                assert.equal(ds.type, 'vector');
+                assert.deepEqual(ds.parameters(), options);
+                assert.throws(function() { ds.featureset(null, function() {}); });
+                ds.featureset(function(err, featureset) {
+                    assert.ifError(err);
+                    var count = 0;
+                    while (featureset.next()) {
+                        count++;
+                    }
+                    assert.equal(count, 245);
+                    ds.featureset({extent: ds.extent()}, function(err, featureset) {
+                        assert.ifError(err);
+                        assert.equal(featureset.next().attributes().NAME, 'Antigua and Barbuda');
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
     it('should validate with known shapefile - ogr', function() {
         var options = {
             type: 'ogr',
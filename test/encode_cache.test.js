@@ -0,0 +1,61 @@
+"use strict";
+
+var mapnik = require('../');
+var assert = require('assert');
+
+describe('mapnik.setEncodeCache', function() {
+    after(function() {
+        mapnik.setEncodeCache({size:0});
+    });
+
+    it('should throw with invalid usage', function() {
+        assert.throws(function() { mapnik.setEncodeCache(); });
+        assert.throws(function() { mapnik.setEncodeCache(null); });
+        assert.throws(function() { mapnik.setEncodeCache({}); });
+        assert.throws(function() { mapnik.setEncodeCache({size:-1}); });
+        assert.throws(function() { mapnik.setEncodeCache({size:'foo'}); });
+    });
+
+    it('should reuse encoded images with the same pixels', function(done) {
+        mapnik.setEncodeCache({size:1024 * 1024});
+        var ocean = new mapnik.Image(256, 256);
+        ocean.fill(new mapnik.Color('#b5d0d0'));
+        var expected = ocean.encodeSync('png');
+        var before = mapnik.encodeCacheStats();
+        assert.equal(before.size, 1024 * 1024);
+        assert.equal(before.entries, 1);
+
+        var other = new mapnik.Image(256, 256);
+        other.fill(new mapnik.Color('#b5d0d0'));
+        other.encode('png', function(err, result) {
+            if (err) throw err;
+            assert.ok(result.equals(expected));
+            var stats = mapnik.encodeCacheStats();
+            assert.equal(stats.hits, before.hits + 1);
+
+            // a different format, pixel or palette is a separate entry
+            other.setPixel(10, 10, new mapnik.Color('red'));
+            assert.ok(!other.encodeSync('png').equals(expected));
+            assert.ok(ocean.encodeSync('png32'));
+            var pal = new mapnik.Palette(new Buffer('\xb5\xd0\xd0\xff\x01\x02\x03\x04','ascii'));
+            assert.ok(ocean.encodeSync('png', {palette:pal}));
+            stats = mapnik.encodeCacheStats();
+            assert.equal(stats.hits, before.hits + 1);
+            assert.equal(stats.entries, 4);
+
+            // views of the same pixels share entries
+            var view = other.view(0, 0, 5, 5);
+            var view_result = view.encodeSync('png');
+            view.encode('png', function(err, result) {
+                if (err) throw err;
+                assert.ok(result.equals(view_result));
+                assert.equal(mapnik.encodeCacheStats().hits, before.hits + 2);
+                mapnik.setEncodeCache({size:0});
+                stats = mapnik.encodeCacheStats();
+                assert.equal(stats.entries, 0);
+                assert.equal(stats.bytes, 0);
+                done();
+            });
+        });
+    });
+});
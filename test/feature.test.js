@@ -80,6 +80,36 @@ describe('mapnik.Feature ', function() {
         assert.equal(count, 245);
     });
 
+    it('should read features in batches', function(done) {
+        var ds = new mapnik.Datasource({type: 'shape', file: './test/data/world_merc.shp'});
+        var featureset = ds.featureset();
+        assert.throws(function() { featureset.nextBatch(); });
+        assert.throws(function() { featureset.nextBatch(0); });
+        assert.throws(function() { featureset.nextBatch(10, null); });
+        assert.throws(function() { featureset.nextBatch(10, {format: 'wkb'}); });
+        var batch = featureset.nextBatch(100);
+        assert.equal(batch.length, 100);
+        assert.equal(batch[0].attributes().NAME, 'Antigua and Barbuda');
+        var lines = featureset.nextBatch(100, {format: 'ndjson'}).toString().trim().split('\n');
+        assert.equal(lines.length, 100);
+        assert.equal(JSON.parse(lines[0]).type, 'Feature');
+        featureset.nextBatch(100, function(err, rest) {
+            assert.ifError(err);
+            assert.equal(rest.length, 45);
+            assert.equal(featureset.nextBatch(100), null);
+            assert.deepEqual(featureset.toArray(), []);
+            var all = ds.featureset();
+            all.toArray({format: 'geojson'}, function(err, buffer) {
+                assert.ifError(err);
+                var collection = JSON.parse(buffer.toString());
+                assert.equal(collection.type, 'FeatureCollection');
+                assert.equal(collection.features.length, 245);
+                done();
+            });
+            assert.throws(function() { all.next(); }, /currently in use/);
+        });
+    });
+
     it('should report null values as js null',function() {
         var extent = '-180,-60,180,60';
         var ds = new mapnik.MemoryDatasource({'extent': extent});
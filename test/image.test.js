@@ -55,6 +55,8 @@ describe('mapnik.Image ', function() {
         assert.throws(function() { im.encode('png', null, function(err, result) {}); });
         assert.throws(function() { im.encode(1, {}, function(err, result) {}); });
         assert.throws(function() { im.encode('png', {}, null); });
+        assert.throws(function() { im.encodeSync('png32', {threads:-1}); });
+        assert.throws(function() { im.encode('png32', {threads:'foo'}, function(err, result) {}); });
         im.encode('foo', {}, function(err, result) {
             assert.throws(function() { if (err) throw err; });
             done();
@@ -72,6 +74,36 @@ describe('mapnik.Image ', function() {
         });
     });
 
+    it('should encode on several threads', function(done) {
+        var width = 700;
+        var height = 900;
+        var data = new Buffer(width * height * 4);
+        for (var i = 0; i < width * height; ++i) {
+            data[i * 4] = i % 251;
+            data[i * 4 + 1] = (i / width) % 256;
+            data[i * 4 + 2] = (i * 7) % 256;
+            // translucent pixels must survive every truecolor format
+            data[i * 4 + 3] = (i % 3 === 0) ? 128 : 255;
+        }
+        var im = new mapnik.Image.fromBufferSync(width, height, data);
+        ['png32', 'png24', 'png24:z=1', 'png32:t=0'].forEach(function(format) {
+            var encoded = im.encodeSync(format, {threads:4});
+            var expected = new mapnik.Image.fromBytesSync(im.encodeSync(format));
+            assert.equal(0, expected.compare(new mapnik.Image.fromBytesSync(encoded), {threshold:0}));
+        });
+        assert.equal(0, im.compare(new mapnik.Image.fromBytesSync(im.encodeSync('png24', {threads:4})), {threshold:0}));
+        im.encode('png32', {threads:4}, function(err, result) {
+            if (err) throw err;
+            assert.equal(0, im.compare(new mapnik.Image.fromBytesSync(result)));
+            // formats that cannot be split are encoded on one thread
+            im.encode('png', {threads:4}, function(err, result) {
+                if (err) throw err;
+                assert.ok(result.equals(im.encodeSync('png')));
+                done();
+            });
+        });
+    });
+
     it('should throw with invalid formats and bad input', function(done) {
         var im = new mapnik.Image(256, 256);
         assert.throws(function() { im.save('foo','foo'); });
@@ -1527,6 +1559,24 @@ describe('mapnik.Image ', function() {
         });
     });
 
+    it('should return pixel data without copying', function() {
+        var im = new mapnik.Image.open('test/data/images/sat_image.png');
+        assert.throws(function() { im.data(null); });
+        assert.throws(function() { im.data({copy:null}); });
+        var copy = im.data();
+        var view = im.data({copy:false});
+        assert.equal(view.length, copy.length);
+        assert.ok(view.equals(copy));
+        // repeated calls hand back the same buffer
+        assert.equal(im.data({copy:false}), view);
+        // changes to the image are visible through the view and vice versa
+        im.setPixel(0, 0, new mapnik.Color(1, 2, 3, 255));
+        assert.deepEqual([view[0], view[1], view[2], view[3]], [1, 2, 3, 255]);
+        assert.notEqual(copy[0], 1);
+        view[0] = 99;
+        assert.equal(im.getPixel(0, 0, {get_color:true}).r, 99);
+    });
+
     it('be able to create image with zero allocation / from raw buffer', function() {
         var im = new mapnik.Image.open('test/data/images/sat_image.png');
         assert.equal(im.premultiplied(), false);
@@ -1561,6 +1611,17 @@ describe('mapnik.Image ', function() {
 
     });
 
+    it('should return the source buffer of a raw buffer image without copying', function() {
+        var im = new mapnik.Image.open('test/data/images/sat_image.png');
+        var data = im.data();
+        var im2 = new mapnik.Image.fromBufferSync(im.width(), im.height(), data);
+        var view = im2.data({copy:false});
+        assert.equal(view, data);
+        assert.equal(im2.data({copy:false}), data);
+        im2.setPixel(0, 0, new mapnik.Color(1, 2, 3, 255));
+        assert.deepEqual([data[0], data[1], data[2], data[3]], [1, 2, 3, 255]);
+    });
+
     it('should fail to use fromBufferSync due to bad input', function() {
         var b = new Buffer(16);
         assert.throws(function() { var im = new mapnik.Image.fromBufferSync(); });
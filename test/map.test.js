@@ -400,4 +400,53 @@ describe('mapnik.Map', function() {
 
     });
 
+    it('should warm up datasources and markers', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/data/ünicode_symbols.xml');
+        assert.throws(function() { map.warmup(); });
+        assert.throws(function() { map.warmup({}); });
+        assert.throws(function() { map.warmup(null, function() {}); });
+        assert.throws(function() { map.warmup({extent: [0, 0, 1]}, function() {}); });
+        assert.throws(function() { map.warmup({zooms: [31]}, function() {}); });
+        assert.throws(function() { map.warmup({fonts: 1}, function() {}); });
+        assert.throws(function() { map.warmup({threads: -1}, function() {}); });
+        map.warmup({threads: 2}, function(err, stats) {
+            assert.ifError(err);
+            assert.deepEqual(Object.keys(stats.layers).sort(), ['frame', 'layer']);
+            assert.ok(stats.layers.layer >= 0);
+            assert.equal(stats.markers, 1);
+            var map2 = new mapnik.Map(256, 256);
+            map2.loadSync('./test/stylesheet.xml');
+            map2.zoomAll();
+            map2.warmup({zooms: [0, 5]}, function(err, stats) {
+                assert.ifError(err);
+                assert.deepEqual(Object.keys(stats.layers), ['world']);
+                assert.equal(stats.markers, 0);
+                map2.render(new mapnik.Image(256, 256), {}, function(err, im) {
+                    assert.ifError(err);
+                    done();
+                });
+            });
+            assert.throws(function() { map2.warmup(function() {}); }, /currently in use/);
+        });
+    });
+
+    it('should count each marker file loaded by warmup once', function(done) {
+        var marker = '<MarkersSymbolizer file="./dir-区县级行政区划/你好-ellipses.svg" />';
+        var xml = '<Map>' +
+            '<Style name="a"><Rule>' + marker + marker + '</Rule></Style>' +
+            '<Style name="b"><Rule>' + marker + '<MarkersSymbolizer file="./does-not-exist.svg" /></Rule></Style>' +
+            '<Layer name="one"><StyleName>a</StyleName></Layer>' +
+            '<Layer name="two"><StyleName>a</StyleName><StyleName>b</StyleName></Layer>' +
+            '</Map>';
+        var map = new mapnik.Map(256, 256);
+        map.fromStringSync(xml, {base: './test/data/'});
+        map.warmup({fonts: false, threads: 2}, function(err, stats) {
+            assert.ifError(err);
+            assert.deepEqual(Object.keys(stats.layers).sort(), ['one', 'two']);
+            assert.equal(stats.markers, 1);
+            done();
+        });
+    });
+
 });
@@ -0,0 +1,113 @@
+"use strict";
+
+var mapnik = require('../');
+var assert = require('assert');
+var path = require('path');
+
+mapnik.register_datasource(path.join(mapnik.settings.paths.input_plugins,'shape.input'));
+
+describe('mapnik.MapPool', function() {
+    it('should throw with invalid usage', function() {
+        var map = new mapnik.Map(256, 256);
+        assert.throws(function() { mapnik.MapPool(map); });
+        assert.throws(function() { new mapnik.MapPool(); });
+        assert.throws(function() { new mapnik.MapPool({}); });
+        assert.throws(function() { new mapnik.MapPool(map, null); });
+        assert.throws(function() { new mapnik.MapPool(map, {size:null}); });
+        assert.throws(function() { new mapnik.MapPool(map, {size:0}); });
+    });
+
+    it('should report its size', function() {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        var pool = new mapnik.MapPool(map, {size:3});
+        assert.equal(pool.size, 3);
+        assert.equal(pool.available, 3);
+        assert.equal(pool.pending, 0);
+    });
+
+    it('should fail to render with invalid arguments', function() {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        var pool = new mapnik.MapPool(map, {size:1});
+        var im = new mapnik.Image(256, 256);
+        assert.throws(function() { pool.render(); });
+        assert.throws(function() { pool.render(im); });
+        assert.throws(function() { pool.render({}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, null, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {extent:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {extent:[0,0,1]}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {buffer_size:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {scale:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {scale_denominator:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {offset_x:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {offset_y:null}, function(err, im) {}); });
+        assert.throws(function() { pool.render(im, {variables:null}, function(err, im) {}); });
+    });
+
+    it('should queue renders when all maps are busy', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.zoomAll();
+        var pool = new mapnik.MapPool(map, {size:2});
+        var expected = new mapnik.Image(256, 256);
+        map.render(expected, function(err) {
+            if (err) throw err;
+            var count = 6;
+            var remaining = count;
+            for (var i = 0; i < count; ++i) {
+                pool.render(new mapnik.Image(256, 256), function(err, im) {
+                    if (err) throw err;
+                    assert.equal(im.compare(expected), 0);
+                    if (--remaining === 0) {
+                        assert.equal(pool.available, 2);
+                        assert.equal(pool.pending, 0);
+                        done();
+                    }
+                });
+            }
+            assert.equal(pool.available, 0);
+            assert.equal(pool.pending, count - 2);
+        });
+    });
+
+    it('should render the requested extent', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        var extent = [-20037508.34,-20037508.34,20037508.34,20037508.34];
+        map.extent = extent;
+        var expected = new mapnik.Image(256, 256);
+        map.render(expected, function(err) {
+            if (err) throw err;
+            map.zoomAll();
+            var pool = new mapnik.MapPool(map, {size:1});
+            pool.render(new mapnik.Image(256, 256), {extent:extent}, function(err, im) {
+                if (err) throw err;
+                assert.equal(im.compare(expected), 0);
+                done();
+            });
+        });
+    });
+
+    it('should fit the extent to the aspect ratio of the image', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.extent = [-20037508.34,-20037508.34,20037508.34,20037508.34];
+        var pool = new mapnik.MapPool(map, {size:1});
+        var expected = new mapnik.Map(512, 256);
+        expected.loadSync('./test/stylesheet.xml');
+        expected.extent = map.extent;
+        expected.render(new mapnik.Image(512, 256), function(err, expected_im) {
+            if (err) throw err;
+            pool.render(new mapnik.Image(512, 256), function(err, im) {
+                if (err) throw err;
+                assert.equal(im.compare(expected_im), 0);
+                pool.render(new mapnik.Image(512, 256), {extent:map.extent}, function(err, im) {
+                    if (err) throw err;
+                    assert.equal(im.compare(expected_im), 0);
+                    done();
+                });
+            });
+        });
+    });
+});
@@ -5,6 +5,7 @@ var assert = require('assert');
 var path = require('path');
 
 mapnik.register_datasource(path.join(mapnik.settings.paths.input_plugins,'shape.input'));
+mapnik.register_datasource(path.join(mapnik.settings.paths.input_plugins,'geojson.input'));
 
 describe('mapnik.queryPoint', function() {
     it('should throw with invalid usage', function() {
@@ -214,4 +215,75 @@ describe('mapnik.queryPoint', function() {
             done();
         });
     });
+
+    it('should read features in the worker if features option is used', function(done) {
+        var map = new mapnik.Map(256, 256);
+        var layer = new mapnik.Layer('world');
+        layer.srs = map.srs;
+        var options = {
+            type: 'shape',
+            file: './test/data/world_merc.shp'
+        };
+        layer.datasource = new mapnik.Datasource(options);
+        map.add_layer(layer);
+        var layer2 = new mapnik.Layer('world2');
+        layer2.srs = map.srs;
+        layer2.datasource = new mapnik.Datasource(options);
+        map.add_layer(layer2);
+        map.zoomAll();
+        assert.throws(function() { map.queryPoint(0, 0, {features:1}, function(err,results) {}); });
+        assert.throws(function() { map.queryPoint(0, 0, {geometry:null}, function(err,results) {}); });
+        assert.throws(function() { map.queryPoint(0, 0, {limit:-1}, function(err,results) {}); });
+        assert.throws(function() { map.queryPoint(0, 0, {threads:'2'}, function(err,results) {}); });
+        map.queryPoint(-12957605.0331, 5518141.9452, {features:true, geometry:false, threads:2}, function(err, results) {
+            assert.ifError(err);
+            assert.equal(results.length, 2);
+            assert.equal(results[0].layer, 'world');
+            assert.equal(results[1].layer, 'world2');
+            assert.equal(results[0].featureset, undefined);
+            results.forEach(function(result) {
+                assert.equal(result.features.length, 1);
+                var feat = result.features[0];
+                assert.equal(feat.attributes().NAME, 'United States');
+                assert.equal(feat.geometry().type(), mapnik.Geometry.Unknown);
+            });
+            map.queryPoint(-12957605.0331, 5518141.9452, {layer: 'world', features:true, limit:1}, function(err, results) {
+                assert.ifError(err);
+                assert.equal(results.length, 1);
+                assert.equal(results[0].features.length, 1);
+                assert.notEqual(results[0].features[0].geometry().type(), mapnik.Geometry.Unknown);
+                done();
+            });
+        });
+    });
+
+    it('should leave the datasource features intact when returning features without geometry', function(done) {
+        var map = new mapnik.Map(256, 256);
+        var layer = new mapnik.Layer('square');
+        layer.datasource = new mapnik.Datasource({
+            type: 'geojson',
+            inline: JSON.stringify({
+                type: 'FeatureCollection',
+                features: [{
+                    type: 'Feature',
+                    properties: {name: 'square'},
+                    geometry: {type: 'Polygon', coordinates: [[[-10,-10],[10,-10],[10,10],[-10,10],[-10,-10]]]}
+                }]
+            })
+        });
+        map.add_layer(layer);
+        map.zoomAll();
+        map.queryPoint(0, 0, {features:true, geometry:false}, function(err, results) {
+            assert.ifError(err);
+            assert.equal(results[0].features.length, 1);
+            assert.equal(results[0].features[0].attributes().name, 'square');
+            assert.equal(results[0].features[0].geometry().type(), mapnik.Geometry.Unknown);
+            map.queryPoint(0, 0, {features:true}, function(err, results) {
+                assert.ifError(err);
+                assert.equal(results[0].features.length, 1);
+                assert.equal(results[0].features[0].geometry().type(), mapnik.Geometry.Polygon);
+                done();
+            });
+        });
+    });
 });
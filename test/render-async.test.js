@@ -164,4 +164,66 @@ describe('mapnik async rendering', function() {
             });
         });
     });
+
+    it('should fail to render a metatile with invalid options', function() {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        assert.throws(function() { map.renderMetatile(); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0}); });
+        assert.throws(function() { map.renderMetatile(null, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({x:0, y:0}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:-1, x:0, y:0}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:1, x:2, y:0}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, metatile:0}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, tile_size:null}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, format:null}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, palette:{}}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, buffer_size:null}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, scale:null}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0, variables:null}, function(err, tiles) {}); });
+        assert.throws(function() { map.renderMetatile({z:10, x:0, y:0, metatile:64, tile_size:512}, function(err, tiles) {}); });
+        assert.doesNotThrow(function() { map.renderMetatile({z:0, x:0, y:0, metatile:64, tile_size:256}, function(err, tiles) {}); });
+    });
+
+    it('should fail to render a metatile of a map not in spherical mercator', function() {
+        var map = new mapnik.Map(256, 256, '+init=epsg:4326');
+        assert.throws(function() { map.renderMetatile({z:0, x:0, y:0}, function(err, tiles) {}); }, /spherical mercator/);
+        map.srs = '+init=epsg:3857';
+        assert.doesNotThrow(function() { map.renderMetatile({z:0, x:0, y:0}, function(err, tiles) {}); });
+    });
+
+    it('should fail to render a metatile with an invalid format', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.renderMetatile({z:0, x:0, y:0, format:'bogus'}, function(err, tiles) {
+            assert.ok(err);
+            done();
+        });
+    });
+
+    it('should render a metatile and split it into tiles', function(done) {
+        var map = new mapnik.Map(512, 512);
+        map.loadSync('./test/stylesheet.xml');
+        map.extent = [-20037508.342789244, -20037508.342789244, 20037508.342789244, 20037508.342789244];
+        var expected = new mapnik.Image(512, 512);
+        map.render(expected, {buffer_size:0}, function(err, expected) {
+            if (err) throw err;
+            // any tile in the metatile can be requested
+            map.renderMetatile({z:1, x:1, y:1, metatile:8, buffer_size:0}, function(err, tiles) {
+                if (err) throw err;
+                // metatile is clipped to the 2x2 tiles of zoom level 1
+                assert.equal(tiles.length, 4);
+                tiles.forEach(function(tile, i) {
+                    var col = i % 2;
+                    var row = Math.floor(i / 2);
+                    var actual = mapnik.Image.fromBytesSync(tile);
+                    var view = expected.view(col * 256, row * 256, 256, 256);
+                    var ex = mapnik.Image.fromBytesSync(view.encodeSync('png'));
+                    assert.equal(actual.width(), 256);
+                    assert.equal(actual.compare(ex), 0);
+                });
+                done();
+            });
+        });
+    });
 });
@@ -132,6 +132,72 @@ describe('mapnik grid rendering ', function() {
         });
     });
 
+    it('should encode to a JSON buffer', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync(stylesheet, {strict: true});
+        map.zoomAll();
+        var grid = new mapnik.Grid(map.width, map.height, {key: '__id__'});
+        var options = {'layer': 0,
+                       'fields': ['NAME', 'LAT', 'LON', 'AREA', 'ISO2', 'ISO3', 'FIPS']
+                      };
+        map.render(grid, options, function(err, grid) {
+            if (err) throw err;
+            var expected = grid.encodeSync({resolution: 4, features:true});
+            var buffer = grid.encodeSync({resolution: 4, features:true, buffer:true});
+            assert.ok(buffer instanceof Buffer);
+            assert.deepEqual(JSON.parse(buffer.toString()), expected);
+            assert.throws(function() { grid.encodeSync({buffer:null}); });
+            var gv = grid.view(64, 64, 64, 64);
+            var expected_view = gv.encodeSync({resolution: 2});
+            grid.encode({resolution: 4, features:true, buffer:true}, function(err, result) {
+                if (err) throw err;
+                assert.deepEqual(JSON.parse(result.toString()), expected);
+                gv.encode({resolution: 2, buffer:true}, function(err, result) {
+                    if (err) throw err;
+                    assert.deepEqual(JSON.parse(result.toString()), expected_view);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('should encode every feature id of a full resolution grid', function(done) {
+        // The world shapefile numbers its features 1..245, so the ids sit close
+        // together and the encoder looks keys up in a flat table.
+        var map = new mapnik.Map(256, 256);
+        map.loadSync(stylesheet, {strict: true});
+        map.zoomAll();
+        var grid = new mapnik.Grid(map.width, map.height, {key: '__id__'});
+        map.render(grid, {layer: 0, fields: ['NAME']}, function(err, grid) {
+            if (err) throw err;
+            var utf = grid.encodeSync({resolution: 1, features: true});
+            assert.equal(utf.grid.length, 256);
+            assert.equal(utf.keys[0], '');
+            assert.ok(utf.keys.length > 100);
+            var view = grid.view(0, 0, 256, 256).encodeSync({resolution: 1, features: true});
+            assert.deepEqual(view, utf);
+            var seen = {};
+            utf.grid.forEach(function(row) {
+                for (var i = 0; i < row.length; ++i) {
+                    var code = row.charCodeAt(i);
+                    if (code >= 93) --code;
+                    if (code >= 35) --code;
+                    code -= 32;
+                    assert.ok(code < utf.keys.length);
+                    seen[utf.keys[code]] = true;
+                }
+            });
+            utf.keys.forEach(function(key) {
+                assert.ok(seen[key], 'key ' + key + ' is drawn');
+                if (key !== '') {
+                    assert.ok(utf.data[key].NAME);
+                }
+            });
+            assert.ok(!('' in utf.data));
+            done();
+        });
+    });
+
     it('should match expected output if __id__ is not the grid key', function(done) {
         var map = new mapnik.Map(256, 256);
         map.loadSync(stylesheet, {strict: true});
@@ -0,0 +1,89 @@
+"use strict";
+
+var mapnik = require('../');
+var assert = require('assert');
+var path = require('path');
+var fs = require('fs');
+
+mapnik.register_datasource(path.join(mapnik.settings.paths.input_plugins,'shape.input'));
+
+describe('mapnik.setStylesheetCache', function() {
+    after(function() {
+        mapnik.setStylesheetCache({size:0});
+    });
+
+    it('should throw with invalid usage', function() {
+        assert.throws(function() { mapnik.setStylesheetCache(); });
+        assert.throws(function() { mapnik.setStylesheetCache(null); });
+        assert.throws(function() { mapnik.setStylesheetCache({}); });
+        assert.throws(function() { mapnik.setStylesheetCache({size:-1}); });
+        assert.throws(function() { mapnik.setStylesheetCache({size:'foo'}); });
+    });
+
+    it('should copy maps loaded from the same stylesheet', function(done) {
+        mapnik.setStylesheetCache({size:2});
+        var expected = new mapnik.Map(256, 256);
+        expected.loadSync('./test/stylesheet.xml');
+        var before = mapnik.stylesheetCacheStats();
+        assert.equal(before.size, 2);
+        assert.equal(before.entries, 1);
+
+        var map = new mapnik.Map(512, 128);
+        map.load('./test/stylesheet.xml', {}, function(err, map) {
+            if (err) throw err;
+            var stats = mapnik.stylesheetCacheStats();
+            assert.equal(stats.hits, before.hits + 1);
+            assert.equal(map.width, 512);
+            assert.equal(map.height, 128);
+            assert.equal(map.toXML(), expected.toXML());
+            assert.equal(map.layers()[0].datasource.parameters().file, expected.layers()[0].datasource.parameters().file);
+
+            // loading into a map which already has layers adds to it
+            map.loadSync('./test/stylesheet.xml');
+            assert.equal(map.layers().length, 2);
+            assert.equal(mapnik.stylesheetCacheStats().hits, stats.hits);
+
+            // stylesheets given as strings have their own entries
+            var xml = fs.readFileSync('./test/stylesheet.xml', 'utf8');
+            var from_string = new mapnik.Map(256, 256);
+            from_string.fromStringSync(xml, {base: './test/'});
+            assert.equal(mapnik.stylesheetCacheStats().entries, 2);
+
+            mapnik.clearStylesheetCache();
+            assert.equal(mapnik.stylesheetCacheStats().entries, 0);
+            done();
+        });
+    });
+
+    it('should keep the aspect_fix_mode and parameters of the map loaded into', function() {
+        mapnik.setStylesheetCache({size:4});
+        mapnik.clearStylesheetCache();
+        var first = new mapnik.Map(256, 256);
+        first.loadSync('./test/stylesheet.xml');
+        var hits = mapnik.stylesheetCacheStats().hits;
+
+        var map = new mapnik.Map(256, 256);
+        map.aspect_fix_mode = mapnik.Map.ASPECT_RESPECT;
+        map.parameters = {name: 'custom', zoom: 4};
+        map.loadSync('./test/stylesheet.xml');
+        assert.equal(map.aspect_fix_mode, mapnik.Map.ASPECT_RESPECT);
+        assert.deepEqual(map.parameters, {name: 'custom', zoom: 4});
+        assert.equal(mapnik.stylesheetCacheStats().hits, hits);
+
+        // a later map with the same settings is copied from that entry
+        var again = new mapnik.Map(256, 256);
+        again.aspect_fix_mode = mapnik.Map.ASPECT_RESPECT;
+        again.parameters = {name: 'custom', zoom: 4};
+        again.loadSync('./test/stylesheet.xml');
+        assert.equal(again.aspect_fix_mode, mapnik.Map.ASPECT_RESPECT);
+        assert.deepEqual(again.parameters, {name: 'custom', zoom: 4});
+        assert.equal(mapnik.stylesheetCacheStats().hits, hits + 1);
+
+        // and the default settings still come from the first entry
+        var plain = new mapnik.Map(256, 256);
+        plain.loadSync('./test/stylesheet.xml');
+        assert.equal(plain.aspect_fix_mode, first.aspect_fix_mode);
+        assert.deepEqual(plain.parameters, first.parameters);
+        assert.equal(mapnik.stylesheetCacheStats().hits, hits + 2);
+    });
+});
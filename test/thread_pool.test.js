@@ -0,0 +1,52 @@
+"use strict";
+
+var mapnik = require('../');
+var assert = require('assert');
+var path = require('path');
+
+mapnik.register_datasource(path.join(mapnik.settings.paths.input_plugins,'shape.input'));
+
+describe('mapnik.setThreadPool', function() {
+    after(function() {
+        // send everything back to the libuv threadpool for the other tests
+        mapnik.setThreadPool({render:0, encode:0});
+    });
+
+    it('should throw with invalid usage', function() {
+        assert.throws(function() { mapnik.setThreadPool(); });
+        assert.throws(function() { mapnik.setThreadPool(null); });
+        assert.throws(function() { mapnik.setThreadPool({render:null}); });
+        assert.throws(function() { mapnik.setThreadPool({encode:-1}); });
+        assert.throws(function() { mapnik.setThreadPool({render:257}); });
+        assert.throws(function() { mapnik.setThreadPool({render:3e9}); });
+    });
+
+    it('should render and encode on dedicated threads', function(done) {
+        mapnik.setThreadPool({render:2, encode:1});
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.zoomAll();
+        var expected = map.renderSync({format:'png'});
+        map.render(new mapnik.Image(256, 256), function(err, im) {
+            if (err) throw err;
+            im.encode('png', function(err, buffer) {
+                if (err) throw err;
+                assert.equal(buffer.length, expected.length);
+                done();
+            });
+        });
+    });
+
+    it('should not resize while work is in progress', function(done) {
+        mapnik.setThreadPool({render:1});
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.zoomAll();
+        map.render(new mapnik.Image(256, 256), function(err) {
+            if (err) throw err;
+            mapnik.setThreadPool({render:2});
+            done();
+        });
+        assert.throws(function() { mapnik.setThreadPool({render:4}); });
+    });
+});
@@ -664,3 +664,42 @@ describe('mapnik.VectorTile query xy single features', function() {
     });
 });
 
+
+describe('mapnik.VectorTile query index', function() {
+    function point(lon, lat, name) {
+        return JSON.stringify({
+            "type": "FeatureCollection",
+            "features": [{
+                "type": "Feature",
+                "geometry": { "type": "Point", "coordinates": [ lon, lat ] },
+                "properties": { "name": name }
+            }]
+        });
+    }
+
+    it('reflects changes to the tile after it was queried', function(done) {
+        var vtile = new mapnik.VectorTile(0,0,0);
+        vtile.addGeoJSON(point(-122, 48, 'A'), 'first');
+        assert.equal(vtile.query(-122, 48, {tolerance:10000}).length, 1);
+        assert.equal(vtile.queryMany([[-122, 48]], {tolerance:10000, layer:'first'}).features.length, 1);
+        vtile.addGeoJSON(point(10, 10, 'B'), 'second');
+        var features = vtile.query(10, 10, {tolerance:10000});
+        assert.equal(features.length, 1);
+        assert.equal(features[0].layer, 'second');
+        assert.equal(features[0].attributes().name, 'B');
+        var other = new mapnik.VectorTile(0,0,0);
+        other.addGeoJSON(point(20, 20, 'C'), 'first');
+        vtile.setData(other.getData());
+        assert.equal(vtile.query(-122, 48, {tolerance:10000}).length, 0);
+        assert.equal(vtile.query(20, 20, {tolerance:10000}).length, 1);
+        vtile.clear();
+        assert.equal(vtile.query(20, 20, {tolerance:10000}).length, 0);
+        vtile.addGeoJSON(point(30, 30, 'D'), 'first');
+        vtile.query(30, 30, {tolerance:10000}, function(err, features) {
+            assert.ifError(err);
+            assert.equal(features.length, 1);
+            assert.equal(features[0].attributes().name, 'D');
+            done();
+        });
+    });
+});
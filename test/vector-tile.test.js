@@ -682,10 +682,92 @@ describe('mapnik.VectorTile ', function() {
         assert.throws(function() { vtile.toGeoJSON(-1, function(err, jstr) {}) });
         assert.throws(function() { vtile.toGeoJSON('foo', function(err, jstr) {}) });
         assert.throws(function() { vtile.toGeoJSON(null, function(err, jstr) {}) });
-        
+
         done();
     });
 
+    it('toGeoJSON should escape strings and keep property types', function() {
+        var vtile = new mapnik.VectorTile(0,0,0);
+        vtile.addGeoJSON(JSON.stringify({
+            type: 'FeatureCollection',
+            features: [{
+                type: 'Feature',
+                id: 7,
+                geometry: { type: 'LineString', coordinates: [[-122, 48], [-121, 47]] },
+                properties: { name: 'say "hi"\n\\', count: 3, ratio: 0.5, flag: true }
+            }]
+        }), 'say "layer"');
+        var out = JSON.parse(vtile.toGeoJSONSync(0));
+        assert.equal(out.name, 'say "layer"');
+        var feature = out.features[0];
+        assert.equal(feature.id, 7);
+        assert.equal(feature.geometry.type, 'LineString');
+        assert.ok(Math.abs(feature.geometry.coordinates[1][0] - -121) < 0.3);
+        assert.ok(Math.abs(feature.geometry.coordinates[1][1] - 47) < 0.3);
+        assert.deepEqual(feature.properties, { name: 'say "hi"\n\\', count: 3, ratio: 0.5, flag: true });
+    });
+
+    it('should stream GeoJSON in chunks', function(done) {
+        var vtile = new mapnik.VectorTile(0,0,0);
+        var layer = function(values) {
+            return JSON.stringify({
+                type: 'FeatureCollection',
+                features: values.map(function(value, i) {
+                    return {
+                        type: 'Feature',
+                        geometry: { type: 'Point', coordinates: [-122 + i, 48] },
+                        properties: { name: value }
+                    };
+                })
+            });
+        };
+        vtile.addGeoJSON(layer(['a', 'b', 'c']), 'one');
+        vtile.addGeoJSON(layer(['d', 'e']), 'two');
+
+        assert.throws(function() { vtile.toGeoJSONReader(null); });
+        assert.throws(function() { vtile.toGeoJSONReader('foo'); });
+        assert.throws(function() { vtile.toGeoJSONReader(5); });
+        assert.throws(function() { vtile.toGeoJSONReader('__all__', null); });
+        assert.throws(function() { vtile.toGeoJSONReader('__all__', {chunk_size:0}); });
+        assert.throws(function() { new mapnik.GeoJSONReader(); });
+        var reader = vtile.toGeoJSONReader('__all__');
+        assert.throws(function() { reader.read(); });
+
+        // chunk_size of one hands back every feature on its own
+        var readAll = function(id, callback) {
+            var reader = vtile.toGeoJSONReader(id, {chunk_size:1});
+            var chunks = [];
+            reader.read(function next(err, chunk) {
+                if (err) throw err;
+                if (chunk === null) return callback(chunks);
+                chunks.push(chunk);
+                reader.read(next);
+            });
+            // only one read at a time
+            assert.throws(function() { reader.read(function() {}); });
+        };
+        readAll('__all__', function(chunks) {
+            assert.equal(chunks.length, 7);
+            assert.equal(Buffer.concat(chunks).toString(), vtile.toGeoJSONSync('__all__'));
+            readAll('__array__', function(chunks) {
+                assert.equal(Buffer.concat(chunks).toString(), vtile.toGeoJSONSync('__array__'));
+                readAll(1, function(chunks) {
+                    assert.equal(Buffer.concat(chunks).toString(), vtile.toGeoJSONSync(1));
+                    var expected = vtile.toGeoJSONSync('one');
+                    var parts = [];
+                    var stream = vtile.toGeoJSONStream('one', {chunk_size:16});
+                    // the stream works from a snapshot of the tile
+                    vtile.clear();
+                    stream.on('data', function(chunk) { parts.push(chunk); });
+                    stream.on('end', function() {
+                        assert.equal(Buffer.concat(parts).toString(), expected);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
     it('should throw with invalid usage', function() {
         // no 'new' keyword
         assert.throws(function() { mapnik.VectorTile(); });
@@ -853,6 +935,36 @@ describe('mapnik.VectorTile ', function() {
             "option 'strategy' must be one of the following strings: FILTERED, HUFFMAN_ONLY, RLE, FIXED, DEFAULT"
         );
     });
+
+    it('should getData without copying', function(done) {
+        var vtile = new mapnik.VectorTile(9,112,195);
+        var data = fs.readFileSync("./test/data/vector_tile/tile1.vector.pbf");
+        vtile.setData(data);
+        assert.throws(function() { vtile.getDataSync({copy:null}); });
+        assert.throws(function() { vtile.getData({copy:null}, function(err,out) {}); });
+        var expected = vtile.getData();
+        var snapshot = vtile.getData({copy:false});
+        assert.equal(snapshot.toString('hex'), expected.toString('hex'));
+        // the snapshot is reused until the tile changes
+        assert.ok(vtile.getData({copy:false}) === snapshot);
+        var gzipped = vtile.getData({compression:'gzip', copy:false});
+        assert.equal(zlib.gunzipSync(gzipped).toString('hex'), expected.toString('hex'));
+        vtile.getData({copy:false}, function(err, out) {
+            if (err) throw err;
+            assert.ok(out === snapshot);
+            vtile.addData(data, function(err) {
+                if (err) throw err;
+                var changed = vtile.getData({copy:false});
+                assert.ok(changed !== snapshot);
+                assert.equal(changed.length, vtile.getData().length);
+                vtile.getData({compression:'gzip', copy:false}, function(err, out) {
+                    if (err) throw err;
+                    assert.equal(zlib.gunzipSync(out).toString('hex'), changed.toString('hex'));
+                    done();
+                });
+            });
+        });
+    });
     
     it('should create empty buffer with getData with no data provided.', function(done) {
         var vtile = new mapnik.VectorTile(9,112,195);
@@ -2161,6 +2273,8 @@ describe('mapnik.VectorTile ', function() {
         assert.throws(function() { map.render(vtile, {variables:null}, function(err, vtile) {}); });
         assert.throws(function() { map.render(vtile, {threading_mode:99}, function(err, vtile) {}); });
         assert.throws(function() { map.render(vtile, {threading_mode:null}, function(err, vtile) {}); });
+        assert.throws(function() { map.render(vtile, {threads:null}, function(err, vtile) {}); });
+        assert.throws(function() { map.render(vtile, {threads:-1}, function(err, vtile) {}); });
         map.render(vtile, {}, function(err, vtile) {
             assert.throws(function() { if (err) throw err; });
             done();
@@ -2209,6 +2323,30 @@ describe('mapnik.VectorTile ', function() {
         });
     });
     
+    it('should render a vector_tile one layer at a time with timings', function(done) {
+        var map = new mapnik.Map(256, 256);
+        map.loadSync('./test/stylesheet.xml');
+        map.extent = [-20037508.34, -20037508.34, 20037508.34, 20037508.34];
+        var world = map.get_layer(0);
+        var world2 = new mapnik.Layer('world2', world.srs);
+        world2.datasource = world.datasource;
+        map.add_layer(world2);
+        var expected = new mapnik.VectorTile(0, 0, 0);
+        map.render(expected, {}, function(err, expected) {
+            if (err) throw err;
+            var vtile = new mapnik.VectorTile(0, 0, 0);
+            map.render(vtile, {threads:2}, function(err, vtile, timings) {
+                if (err) throw err;
+                assert.deepEqual(vtile.names(), ['world', 'world2']);
+                assert.deepEqual(Object.keys(timings), ['world', 'world2']);
+                assert.ok(timings.world >= 0);
+                assert.equal(vtile.getData().length, expected.getData().length);
+                assert.equal(JSON.stringify(vtile.toJSON()), JSON.stringify(expected.toJSON()));
+                done();
+            });
+        });
+    });
+
     it('should render a vector_tile of the whole world with threading auto', function(done) {
         var vtile = new mapnik.VectorTile(0, 0, 0);
         var map = new mapnik.Map(256, 256);